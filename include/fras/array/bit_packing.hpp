@@ -0,0 +1,492 @@
+#ifndef INCLUDED_FRAS_ARRAY_BIT_PACKING
+#define INCLUDED_FRAS_ARRAY_BIT_PACKING
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace fras {
+
+/**
+ * Byte-based bit packing routines shared by the bit packed jagged arrays.
+ * Values are packed most significant bit first into uint8_t cells.
+ **/
+
+const std::size_t BP_CELL_SIZE = sizeof(uint8_t) * 8;
+const std::size_t BP_INT_SIZE = sizeof(uint64_t) * 8;
+
+// most significant bit
+inline int msb(uint64_t value)
+{
+  //return std::ceil(log2(value));
+  return BP_INT_SIZE - __builtin_clzll(value | 1);
+}
+
+// the number of uint8_t cells needed to pack length values of the given width
+inline std::size_t packedSize(int width, uint64_t length)
+{
+  return (((std::size_t) width * length) + BP_CELL_SIZE - 1) / BP_CELL_SIZE;
+}
+
+// assumes the given array has been sized appropriately and all values
+// initialized to 0
+template <class T>
+inline void packArray(uint8_t* array, int width, const T* values, uint64_t length)
+{
+  const std::size_t size = BP_CELL_SIZE;
+  // pack the values into the array
+  uint64_t j = 0;
+  int offset = 0;
+  for (uint64_t i = 0; i < length; i++) {
+    uint64_t value = values[i];
+    // get the index that the character starts at and its offset
+    //assert(j == (i * width) / size);
+    //assert(offset == (i * width) % size);
+    // the value is completely stored in entry j
+    if (offset + width <= size) {
+      array[j] |= value << size - width - offset;
+      offset += width;
+      if (offset >= size) {
+        offset %= size;
+        j += 1;
+      }
+    // the value is split between two or more entries, starting at j
+    } else {
+      int shift = width + offset - size;
+      do {
+        array[j++] |= value >> shift;
+        shift -= size;
+      } while(shift > 0);
+      if (shift == 0) {
+        array[j++] |= value;
+        offset = 0;
+      // shift < 0
+      } else {
+        array[j] |= value << -shift;
+        offset = size + shift;
+      }
+    }
+  }
+}
+
+inline uint64_t unpackValue(const uint8_t* array, int width, uint64_t i)
+{
+  const std::size_t size = BP_CELL_SIZE;
+  // mask the bits left of the packed value
+  uint64_t value = ((uint64_t) 1 << width) - 1;
+  // get the index that the character starts at and its offset
+  uint64_t j = (i * width) / size;
+  int offset = (i * width) % size;
+  // the value is completely stored in entry j
+  if (offset + width <= size) {
+    // get the packed value
+    value &= array[j] >> size - width - offset;
+  // the value is split between two or more entries, starting at j
+  } else {
+    int shift = width + offset - size;
+    value &= (uint64_t) array[j++] << shift;
+    shift -= size;
+    while (shift > 0) {
+      value |= (uint64_t) array[j++] << shift;
+      shift -= size;
+    }
+    if (shift == 0) {
+      value |= array[j];
+    // shift < 0
+    } else {
+      value |= array[j] >> -shift;
+    }
+  }
+  return value;
+}
+
+// word-aligned bit packing: values are packed least significant bit first so
+// that any value can be read from the little-endian 64-bit word starting at the
+// value's first byte; assumes 64 bits of zeroed padding after the array
+inline uint64_t loadWord(const uint8_t* array)
+{
+  uint64_t word;
+  memcpy(&word, array, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+inline void storeWord(uint8_t* array, uint64_t word)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  memcpy(array, &word, sizeof(uint64_t));
+}
+
+// packs the values starting at the given bit of the array
+template <class T>
+inline void packArrayWord(uint8_t* array, int width, const T* values, uint64_t length, uint64_t bit = 0)
+{
+  uint64_t mask = ((uint64_t) 1 << width) - 1;
+  for (uint64_t i = 0; i < length; i++, bit += width) {
+    uint8_t* cell = array + (bit >> 3);
+    storeWord(cell, loadWord(cell) | (((uint64_t) values[i] & mask) << (bit & 7)));
+  }
+}
+
+// one unaligned load, a shift, and a mask; the shift is at most 7 so widths up
+// to 57 bits are supported
+inline uint64_t unpackBits(const uint8_t* array, uint64_t bit, int width)
+{
+  uint64_t mask = ((uint64_t) 1 << width) - 1;
+  return (loadWord(array + (bit >> 3)) >> (bit & 7)) & mask;
+}
+
+inline uint64_t unpackValueWord(const uint8_t* array, int width, uint64_t i)
+{
+  return unpackBits(array, (uint64_t) i * width, width);
+}
+
+// decodes length consecutive values starting at the given bit; the scalar
+// fallback for unpackArrayBits
+template <class T>
+inline void unpackArrayBitsScalar(const uint8_t* array, uint64_t bit, int width, uint64_t length, T* values)
+{
+  for (uint64_t k = 0; k < length; k++, bit += width) {
+    values[k] = unpackBits(array, bit, width);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// decodes four values per iteration by gathering the 64-bit words that start
+// at each value's first byte and shifting each lane by its own bit offset;
+// works for every width unpackBits supports
+template <class T>
+__attribute__((target("avx2")))
+inline void unpackArrayBitsAvx2(const uint8_t* array, uint64_t bit, int width, uint64_t length, T* values)
+{
+  const __m256i mask = _mm256_set1_epi64x(((uint64_t) 1 << width) - 1);
+  const __m256i offsetMask = _mm256_set1_epi64x(7);
+  const __m256i step = _mm256_set1_epi64x(4 * (int64_t) width);
+  const __m256i lanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  __m256i bits = _mm256_setr_epi64x(bit, bit + width, bit + 2 * width, bit + 3 * width);
+  uint64_t k = 0;
+  for (; k + 4 <= length; k += 4) {
+    __m256i cells = _mm256_srli_epi64(bits, 3);
+    __m256i words = _mm256_i64gather_epi64((const long long*) array, cells, 1);
+    __m256i shifted = _mm256_srlv_epi64(words, _mm256_and_si256(bits, offsetMask));
+    __m256i unpacked = _mm256_and_si256(shifted, mask);
+    if constexpr (sizeof(T) == sizeof(uint64_t)) {
+      _mm256_storeu_si256((__m256i*) (values + k), unpacked);
+    } else {
+      // move the low 32 bits of each 64-bit lane into the low 128 bits
+      __m256i packed = _mm256_permutevar8x32_epi32(unpacked, lanes);
+      _mm_storeu_si128((__m128i*) (values + k), _mm256_castsi256_si128(packed));
+    }
+    bits = _mm256_add_epi64(bits, step);
+  }
+  unpackArrayBitsScalar(array, bit + (uint64_t) k * width, width, length - k, values + k);
+}
+#endif
+
+// decodes length consecutive values starting at the given bit using the AVX2
+// kernel when the CPU supports it; like unpackBits, values beyond the array may
+// only be read if they lie in the padding
+template <class T>
+inline void unpackArrayBits(const uint8_t* array, uint64_t bit, int width, uint64_t length, T* values)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if constexpr (sizeof(T) == sizeof(uint32_t) || sizeof(T) == sizeof(uint64_t)) {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2 && length >= 8) {
+      unpackArrayBitsAvx2(array, bit, width, length, values);
+      return;
+    }
+  }
+#endif
+  unpackArrayBitsScalar(array, bit, width, length, values);
+}
+
+// decodes length consecutive values starting at value i
+template <class T>
+inline void unpackArrayWord(const uint8_t* array, int width, uint64_t i, uint64_t length, T* values)
+{
+  unpackArrayBits(array, (uint64_t) i * width, width, length, values);
+}
+
+// per-width kernels for the byte layout: eight values of width W take exactly
+// W bytes, so value k of every group of eight starts at the same byte and bit
+// of its group and a kernel instantiated for W decodes a group with constant
+// offsets, shifts, and masks
+inline uint64_t loadWordMsb(const uint8_t* array)
+{
+  uint64_t word;
+  memcpy(&word, array, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+// value K of the group of eight W-bit values starting at the given byte; when
+// padded, the 64-bit word at the value's first byte is read, otherwise only the
+// bytes the value occupies
+template <int W, int K, bool PADDED>
+inline uint64_t unpackGroupValue(const uint8_t* group)
+{
+  constexpr int BYTE = K * W / 8;
+  constexpr int OFFSET = K * W % 8;
+  constexpr int BYTES = (OFFSET + W + 7) / 8;
+  constexpr uint64_t MASK = (W == 64) ? ~(uint64_t) 0 : ((uint64_t) 1 << W) - 1;
+  uint64_t word = 0;
+  if constexpr (PADDED) {
+    word = loadWordMsb(group + BYTE);
+  } else {
+    for (int b = 0; b < BYTES && b < 8; b++) {
+      word |= (uint64_t) group[BYTE + b] << (56 - 8 * b);
+    }
+  }
+  // the value ends in the ninth byte
+  if constexpr (OFFSET + W > 64) {
+    return ((word << OFFSET) | (group[BYTE + 8] >> (8 - OFFSET))) >> (64 - W);
+  } else {
+    return (word >> (64 - OFFSET - W)) & MASK;
+  }
+}
+
+// decodes the eight values of a group; reads up to 64 bits past the group
+template <int W, class T>
+inline void unpackGroup(const uint8_t* group, T* values)
+{
+  [&]<int... K>(std::integer_sequence<int, K...>) {
+    ((values[K] = unpackGroupValue<W, K, true>(group)), ...);
+  }(std::make_integer_sequence<int, 8>());
+}
+
+// decodes the values of a group up to and including the first 0, reading only
+// the bytes of the values decoded; returns the number of values decoded
+template <int W, class T>
+inline int unpackGroupTerminated(const uint8_t* group, T* values)
+{
+  int n = 0;
+  [&]<int... K>(std::integer_sequence<int, K...>) {
+    ((n++, (values[K] = unpackGroupValue<W, K, false>(group)) != 0) && ...);
+  }(std::make_integer_sequence<int, 8>());
+  return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// the vector kernels read values k and k + 1 of a group, for even k, from the
+// 16 bytes starting at value k's first byte, move the 64-bit word starting at
+// each value's first byte into a lane, and shift each lane by a constant; this
+// supports widths up to 57 bits
+const int BP_GROUP_MAX_WIDTH = 57;
+
+// the number of bytes read from the start of a group
+constexpr int bpGroupReadSize(int width)
+{
+  return 6 * width / 8 + 16;
+}
+
+// the byte shuffle that moves each value's word into its lane, most
+// significant byte last
+template <int W>
+constexpr std::array<int8_t, 64> bpGroupShuffle()
+{
+  std::array<int8_t, 64> shuffle{};
+  for (int k = 0; k < 8; k++) {
+    int base = (k & ~1) * W / 8;
+    for (int j = 0; j < 8; j++) {
+      shuffle[8 * k + j] = k * W / 8 - base + 7 - j;
+    }
+  }
+  return shuffle;
+}
+
+// the right shift that aligns each value with the bottom of its lane
+template <int W>
+constexpr std::array<int64_t, 8> bpGroupShifts()
+{
+  std::array<int64_t, 8> shifts{};
+  for (int k = 0; k < 8; k++) {
+    shifts[k] = 64 - k * W % 8 - W;
+  }
+  return shifts;
+}
+
+template <int W>
+inline constexpr std::array<int8_t, 64> BP_GROUP_SHUFFLE = bpGroupShuffle<W>();
+
+template <int W>
+inline constexpr std::array<int64_t, 8> BP_GROUP_SHIFTS = bpGroupShifts<W>();
+
+// two values per vector; SSE has no per-lane shifts, so each lane is shifted
+// by its constant and the lanes are blended with masks
+template <int W, class T>
+__attribute__((target("ssse3")))
+inline void unpackGroupsSsse3(const uint8_t* array, uint64_t groups, T* values)
+{
+  constexpr uint64_t MASK = ((uint64_t) 1 << W) - 1;
+  const __m128i low = _mm_set_epi64x(0, MASK);
+  const __m128i high = _mm_set_epi64x(MASK, 0);
+  for (uint64_t g = 0; g < groups; g++, array += W, values += 8) {
+    for (int k = 0; k < 8; k += 2) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*) (array + k * W / 8));
+      __m128i shuffle = _mm_loadu_si128((const __m128i*) (BP_GROUP_SHUFFLE<W>.data() + 8 * k));
+      __m128i words = _mm_shuffle_epi8(bytes, shuffle);
+      __m128i unpacked = _mm_or_si128(
+        _mm_and_si128(_mm_srli_epi64(words, BP_GROUP_SHIFTS<W>[k]), low),
+        _mm_and_si128(_mm_srli_epi64(words, BP_GROUP_SHIFTS<W>[k + 1]), high));
+      if constexpr (sizeof(T) == sizeof(uint64_t)) {
+        _mm_storeu_si128((__m128i*) (values + k), unpacked);
+      } else {
+        // move the low 32 bits of each 64-bit lane into the low 64 bits
+        _mm_storel_epi64((__m128i*) (values + k), _mm_shuffle_epi32(unpacked, _MM_SHUFFLE(3, 1, 2, 0)));
+      }
+    }
+  }
+}
+
+// four values per vector, with a variable shift per lane
+template <int W, class T>
+__attribute__((target("avx2")))
+inline void unpackGroupsAvx2(const uint8_t* array, uint64_t groups, T* values)
+{
+  const __m256i mask = _mm256_set1_epi64x(((uint64_t) 1 << W) - 1);
+  const __m256i lanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  for (uint64_t g = 0; g < groups; g++, array += W, values += 8) {
+    for (int k = 0; k < 8; k += 4) {
+      __m128i first = _mm_loadu_si128((const __m128i*) (array + k * W / 8));
+      __m128i second = _mm_loadu_si128((const __m128i*) (array + (k + 2) * W / 8));
+      __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+      __m256i shuffle = _mm256_loadu_si256((const __m256i*) (BP_GROUP_SHUFFLE<W>.data() + 8 * k));
+      __m256i shifts = _mm256_loadu_si256((const __m256i*) (BP_GROUP_SHIFTS<W>.data() + k));
+      __m256i words = _mm256_shuffle_epi8(bytes, shuffle);
+      __m256i unpacked = _mm256_and_si256(_mm256_srlv_epi64(words, shifts), mask);
+      if constexpr (sizeof(T) == sizeof(uint64_t)) {
+        _mm256_storeu_si256((__m256i*) (values + k), unpacked);
+      } else {
+        // move the low 32 bits of each 64-bit lane into the low 128 bits
+        __m256i packed = _mm256_permutevar8x32_epi32(unpacked, lanes);
+        _mm_storeu_si128((__m128i*) (values + k), _mm256_castsi256_si128(packed));
+      }
+    }
+  }
+}
+#endif
+
+// decodes the given number of groups starting at the given byte with the
+// widest kernel the CPU supports; bytes up to end may be read, which must
+// include 64 bits of padding after the last group
+template <int W, class T>
+inline void unpackGroups(const uint8_t* array, uint64_t groups, const uint8_t* end, T* values)
+{
+  uint64_t g = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  if constexpr (W <= BP_GROUP_MAX_WIDTH) {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    // the number of groups the vector kernels can read without passing end
+    uint64_t size = end - array;
+    uint64_t read = bpGroupReadSize(W);
+    g = (size < read) ? 0 : std::min(groups, (size - read) / W + 1);
+    if (avx2) {
+      unpackGroupsAvx2<W>(array, g, values);
+    } else if (ssse3) {
+      unpackGroupsSsse3<W>(array, g, values);
+    } else {
+      g = 0;
+    }
+  }
+#endif
+  for (; g < groups; g++) {
+    unpackGroup<W>(array + g * W, values + 8 * g);
+  }
+}
+
+// decodes groups up to and including the first 0; returns the number of values
+// decoded
+template <int W, class T>
+inline uint64_t unpackGroupsTerminated(const uint8_t* array, uint64_t groups, T* values)
+{
+  for (uint64_t g = 0; g < groups; g++) {
+    int n = unpackGroupTerminated<W>(array + g * W, values + 8 * g);
+    if (values[8 * g + n - 1] == 0) return 8 * g + n;
+  }
+  return 8 * groups;
+}
+
+// the kernels indexed by width - 1
+template <class T>
+using BpGroupKernel = void (*)(const uint8_t*, uint64_t, const uint8_t*, T*);
+
+template <class T>
+using BpTerminatedGroupKernel = uint64_t (*)(const uint8_t*, uint64_t, T*);
+
+template <class T, int... W>
+constexpr std::array<BpGroupKernel<T>, sizeof...(W)> bpGroupKernels(std::integer_sequence<int, W...>)
+{
+  return {{&unpackGroups<W + 1, T>...}};
+}
+
+template <class T, int... W>
+constexpr std::array<BpTerminatedGroupKernel<T>, sizeof...(W)> bpTerminatedGroupKernels(std::integer_sequence<int, W...>)
+{
+  return {{&unpackGroupsTerminated<W + 1, T>...}};
+}
+
+template <class T>
+inline constexpr auto BP_GROUP_KERNELS = bpGroupKernels<T>(std::make_integer_sequence<int, sizeof(T) * 8>());
+
+template <class T>
+inline constexpr auto BP_TERMINATED_GROUP_KERNELS = bpTerminatedGroupKernels<T>(std::make_integer_sequence<int, sizeof(T) * 8>());
+
+// decodes length consecutive values starting at value i, one at a time up to
+// the first group and after the last and with the kernel for the width in
+// between; bytes up to end may be read, which must include 64 bits of padding
+// after the array
+template <class T>
+inline void unpackArray(const uint8_t* array, int width, uint64_t i, uint64_t length, T* values, const uint8_t* end)
+{
+  uint64_t k = 0;
+  for (; k < length && (i + k) % 8 != 0; k++) {
+    values[k] = unpackValue(array, width, i + k);
+  }
+  uint64_t groups = (length - k) / 8;
+  if (groups > 0) {
+    BP_GROUP_KERNELS<T>[width - 1](array + (i + k) / 8 * width, groups, end, values + k);
+    k += 8 * groups;
+  }
+  for (; k < length; k++) {
+    values[k] = unpackValue(array, width, i + k);
+  }
+}
+
+// like unpackArray but for arrays terminated by a 0 and without padding: stops
+// after the first 0 and returns the number of values decoded
+template <class T>
+inline uint64_t unpackArrayTerminated(const uint8_t* array, int width, uint64_t i, uint64_t length, T* values)
+{
+  uint64_t k = 0;
+  for (; k < length && (i + k) % 8 != 0; k++) {
+    if ((values[k] = unpackValue(array, width, i + k)) == 0) return k + 1;
+  }
+  uint64_t groups = (length - k) / 8;
+  if (groups > 0) {
+    uint64_t n = BP_TERMINATED_GROUP_KERNELS<T>[width - 1](array + (i + k) / 8 * width, groups, values + k);
+    k += n;
+    if (values[k - 1] == 0) return k;
+  }
+  for (; k < length; k++) {
+    if ((values[k] = unpackValue(array, width, i + k)) == 0) return k + 1;
+  }
+  return length;
+}
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef INCLUDED_FRAS_ARRAY_ELIAS_FANO_OFFSETS
+#define INCLUDED_FRAS_ARRAY_ELIAS_FANO_OFFSETS
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/util.hpp>
+
+namespace fras {
+
+/**
+ * Stores the offsets of the subarrays of a jagged array in an Elias-Fano
+ * encoded sd_vector, which takes a few bits per subarray. Offsets are appended
+ * in order in a plain vector and then indexed once every subarray has been
+ * set. Offset i + i is stored for every subarray i and the end so that the
+ * positions are distinct even when subarrays are empty.
+ **/
+class EliasFanoOffsets
+{
+  private:
+
+    // the offsets of the subarrays until they're indexed
+    std::vector<uint64_t> tmpOffsets;
+
+    sdsl::sd_vector<> offsetBitvector;
+    sdsl::sd_vector<>::select_1_type offsetBitvectorSelect;
+
+  public:
+
+    EliasFanoOffsets(uint64_t numArrays)
+    {
+      tmpOffsets.reserve(numArrays + 1);
+      tmpOffsets.push_back(0);
+    }
+
+    // the offset subarray index ends at; skipped subarrays are empty
+    void append(uint64_t index, uint64_t end)
+    {
+      if (index + 1 < tmpOffsets.size()) {
+        throw std::runtime_error("Elias-Fano jagged array subarrays must be set in order");
+      }
+      tmpOffsets.resize(index + 1, tmpOffsets.back());
+      tmpOffsets.push_back(end);
+    }
+
+    void index()
+    {
+      for (uint64_t i = 0; i < tmpOffsets.size(); i++) {
+        tmpOffsets[i] += i;
+      }
+      offsetBitvector = sdsl::sd_vector<>(tmpOffsets.begin(), tmpOffsets.end());
+      offsetBitvectorSelect = sdsl::sd_vector<>::select_1_type(&offsetBitvector);
+      std::vector<uint64_t>().swap(tmpOffsets);
+    }
+
+    // the offset subarray index starts at, or the end if index is the number of subarrays
+    uint64_t get(uint64_t index)
+    {
+      return offsetBitvectorSelect.select(index + 1) - index;
+    }
+
+    uint64_t getMemSize()
+    {
+      return sdsl::size_in_bytes(offsetBitvector) + sdsl::size_in_bytes(offsetBitvectorSelect);
+    }
+};
+
+}
+
+#endif
@@ -1,25 +1,135 @@
 #ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY
 #define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY
 
+#include <concepts>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "fras/array/mapped_file.hpp"
+#include "fras/array/subarray_allocator.hpp"
+
 namespace fras {
 
-/** An abstract class that provides an interface for jagged array implementations. */
+/**
+ * The interface that jagged array implementations provide. Implementations are
+ * used as template parameters, e.g. of CFG, rather than through virtual
+ * methods so that accessing a value can be resolved at compile time and
+ * inlined.
+ *
+ * getValues decodes up to length values of a subarray, starting at the given
+ * item, into a caller-supplied buffer and returns the number of values
+ * decoded. Subarrays are assumed to end with a 0 terminator, like CFG rules
+ * do; fewer values are decoded if the subarray ends first, but the terminator
+ * is always decoded.
+ **/
+template <class T>
+concept JaggedArrayType = std::unsigned_integral<typename T::Symbol> &&
+                          std::unsigned_integral<typename T::Offset> &&
+                          requires(T array, typename T::Symbol index, typename T::Offset item, typename T::Offset length, typename T::Symbol* values)
+{
+    { array.setArray(index, values, length) };
+    { array.clearArray(index) };
+    { array.getValue(index, item) } -> std::convertible_to<typename T::Symbol>;
+    { array.getValues(index, item, length, values) } -> std::convertible_to<typename T::Offset>;
+    { array.getNumArrays() } -> std::convertible_to<typename T::Symbol>;
+    { array.getMemSize() } -> std::convertible_to<uint64_t>;
+};
+
+/**
+ * Jagged arrays whose subarrays are all pairs, except the last one, can also
+ * return both values of a pair at once.
+ **/
+template <class T>
+concept PairJaggedArrayType = JaggedArrayType<T> && requires(T array, typename T::Symbol index, typename T::Symbol& left, typename T::Symbol& right)
+{
+    { array.getPair(index, left, right) };
+};
+
+/**
+ * Jagged arrays that store the lengths of their subarrays out of band can
+ * return the length of a subarray, not including its terminator, without
+ * decoding it.
+ **/
+template <class T>
+concept LengthJaggedArrayType = JaggedArrayType<T> && requires(T array, typename T::Symbol index)
+{
+    { array.getLength(index) } -> std::convertible_to<typename T::Offset>;
+};
+
+/**
+ * Jagged arrays that allocate each subarray separately can take the
+ * Allocation their subarrays are allocated with when they're constructed.
+ **/
+template <class T>
+concept AllocationJaggedArrayType = JaggedArrayType<T> && std::constructible_from<T, typename T::Symbol, Allocation>;
+
+/**
+ * Jagged arrays that can be serialized write themselves to a stream and can
+ * be constructed from a MappedFile the stream was written to, in which case
+ * they use the mapped memory in place where they can. Arrays constructed from
+ * a MappedFile are read-only. ENCODING names the encoding the stream was
+ * written with so it doesn't depend on the compiler.
+ **/
+template <class T>
+concept SerializableJaggedArrayType = JaggedArrayType<T> && std::constructible_from<T, MappedFile&> && requires(T array, std::ostream& out)
+{
+    { array.serialize(out) };
+    { T::ENCODING } -> std::convertible_to<const char*>;
+};
+
+/**
+ * Jagged arrays whose subarrays, except the last, can be set from several
+ * threads at once declare CONCURRENT_SET, e.g. because each subarray is stored
+ * in its own allocation. Each subarray must be set by a single thread, the last
+ * subarray must be set after the others, and arrays that take an Allocation
+ * must use Allocation::MALLOC, since arenas are not thread-safe.
+ **/
+template <class T>
+concept ConcurrentJaggedArrayType = JaggedArrayType<T> && T::CONCURRENT_SET;
+
+/**
+ * Jagged arrays that can set a range of subarrays at once from several
+ * threads, e.g. because how each subarray is packed depends on the subarrays
+ * before it, provide setArrays(begin, end, threads, values), which sets
+ * subarrays [begin, end) and calls values(index, buffer) to fill the buffer
+ * with the values of a subarray, terminator included. values may be called
+ * more than once per subarray, from any of the threads, and must fill the
+ * buffer the same way every time. The subarrays before begin must already be
+ * set, and arrays that take an Allocation must use Allocation::MALLOC.
+ **/
+template <class T>
+concept BatchJaggedArrayType = JaggedArrayType<T> && requires(T array, typename T::Symbol index, uint64_t threads, void (*values)(typename T::Symbol, std::vector<typename T::Symbol>&))
+{
+    { array.setArrays(index, index, threads, values) };
+};
+
+/**
+ * A base class for jagged array implementations. Symbol_T is the type of the
+ * values and of subarray indexes, and Offset_T is the type of subarray lengths
+ * and of positions in subarrays. Both are unsigned, e.g. uint32_t for compact
+ * grammars and uint64_t for grammars with billions of rules or characters.
+ **/
+template <class Symbol_T, class Offset_T>
 class JaggedArray
 {
+  public:
+
+    typedef Symbol_T Symbol;
+    typedef Offset_T Offset;
+
   protected:
 
-    int numArrays;
+    Symbol_T numArrays;
 
-  public:
+    // serializable implementations read and write the number of arrays first
+    JaggedArray(MappedFile& file): numArrays(file.readValue<Symbol_T>()) { }
+    void serialize(std::ostream& out) { writeValue(out, numArrays); }
 
-    JaggedArray(int numArrays): numArrays(numArrays) { }
+  public:
 
-    virtual void setArray(int index, int* array, int length) = 0;
-    virtual void clearArray(int index) = 0;
-    virtual int getValue(int index, int item) = 0;
+    JaggedArray(Symbol_T numArrays): numArrays(numArrays) { }
 
-    const int& getNumArrays() const { return numArrays; }
-    virtual int getMemSize() = 0;
+    const Symbol_T& getNumArrays() const { return numArrays; }
 };
 
 }
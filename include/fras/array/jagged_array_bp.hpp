@@ -1,209 +1,131 @@
 #ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP
 #define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP
 
+#include "fras/array/bit_packing.hpp"
 #include "fras/array/jagged_array.hpp"
+#include "fras/array/subarray_allocator.hpp"
 #include <cstdint>
 
 namespace fras {
 
 /**
- * An abstract class that provides an interface for jagged array implementations based on bit packing.
- * The class also provides a commmon byte representation with code for encoding/decoding code.
+ * A base class for jagged array implementations based on bit packing.
+ * Each subarray is stored in its own allocation, made with the given
+ * Allocation, using the common byte representation from bit_packing.hpp. The
+ * Derived class provides the pack widths via setPackWidth and getPackWidth,
+ * which are resolved statically, i.e. using the curiously recurring template
+ * pattern.
  **/
-class JaggedArrayBp : public JaggedArray
+template <class Derived, class Symbol_T, class Offset_T>
+class JaggedArrayBp : public JaggedArray<Symbol_T, Offset_T>
 {
   protected:
 
-    const std::size_t size = sizeof(uint8_t) * 8;
-    const std::size_t intSizeBits = sizeof(int) * 8;
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    const std::size_t size = BP_CELL_SIZE;
+
+    SubarrayAllocator allocator;
 
     uint8_t** arrays;
 
-    // most significant bit
-    int msb(int value)
+    // packs a subarray with the given width, which the Derived class has
+    // already recorded; subarrays can be packed from several threads at once
+    void setPackedArray(Symbol_T index, int width, Symbol_T* values, Offset_T length)
     {
-      //return std::ceil(log2(value));
-      return intSizeBits - __builtin_clz(value | 1);
-    }
+      // compute the smallest uint8_t array that will hold all the bits
+      std::size_t n = packedSize(width, length);
 
-    // assumes the given array has been sized appropriately and all values
-    // initialized to 0
-    void packArray(uint8_t* array, int width, int* values, int length)
-    {
-      // pack the values into the array
-      int j = 0;
-      int offset = 0;
-      for (int i = 0; i < length; i++) {
-        int value = values[i];
-        // get the index that the character starts at and its offset
-        //assert(j == (i * width) / size);
-        //assert(offset == (i * width) % size);
-        // the value is completely stored in entry j
-        if (offset + width <= size) {
-          array[j] |= value << size - width - offset;
-          offset += width;
-          if (offset >= size) {
-            offset %= size;
-            j += 1;
-          }
-        // the value is split between two or more entries, starting at j
-        } else {
-          int shift = width + offset - size;
-          do {
-            array[j++] |= value >> shift;
-            shift -= size;
-          } while(shift > 0);
-          if (shift == 0) {
-            array[j++] |= value;
-            offset = 0;
-          // shift < 0
-          } else {
-            array[j] |= value << -shift;
-            offset = size + shift;
-          }
-        }
+      // allocate and initialize the new array
+      allocator.deallocate(arrays[index]);
+      uint8_t* array = arrays[index] = (uint8_t*) allocator.allocate(sizeof(uint8_t) * n, alignof(uint8_t));
+      for (std::size_t i = 0; i < n; i++) {
+        array[i] = 0;
       }
-    }
 
-    int unpackValue(uint8_t* array, int width, int i)
-    {
-      // mask the bits left of the packed value
-      int value = (1 << width) - 1;
-      // get the index that the character starts at and its offset
-      int j = (i * width) / size;
-      int offset = (i * width) % size;
-      // the value is completely stored in entry j
-      if (offset + width <= size) {
-        // get the packed value
-        value &= array[j] >> size - width - offset;
-      // the value is split between two or more entries, starting at j
-      } else {
-        int shift = width + offset - size;
-        value &= array[j++] << shift;
-        shift -= size;
-        while (shift > 0) {
-          value |= array[j++] << shift;
-          shift -= size;
-        }
-        if (shift == 0) {
-          value |= array[j];
-        // shift < 0
-        } else {
-          value |= array[j] >> -shift;
-        }
-      }
-      return value;
+      // pack the new array
+      packArray(array, width, values, length);
     }
 
   public:
 
-    JaggedArrayBp(int numArrays): JaggedArray(numArrays) {
+    // subarrays are allocated separately, so they can be set concurrently if
+    // the Derived class's pack widths don't depend on other subarrays
+    static const bool CONCURRENT_SET = true;
+
+    JaggedArrayBp(Symbol_T numArrays, Allocation allocation = Allocation::MALLOC): JaggedArray<Symbol_T, Offset_T>(numArrays), allocator(allocation) {
       // initialize the jagged array
       arrays = new uint8_t*[numArrays];
-      for (int i = 0; i < numArrays; i++) {
+      for (Symbol_T i = 0; i < numArrays; i++) {
         arrays[i] = NULL;
       }
     }
 
     ~JaggedArrayBp()
     {
-      for (int i = 0; i < numArrays; i++) {
-        free(arrays[i]);
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        allocator.deallocate(arrays[i]);
       }
       delete[] arrays;
     }
 
-    int getMemSize()
+    uint64_t getMemSize()
     {
-      int memSize = 0;
+      uint64_t memSize = 0;
 
-      // get the index that the character starts at and its offset
-      for (int i = 0; i < numArrays; i++) {
+      // every subarray is packed up to and including its terminator
+      for (Symbol_T i = 0; i < numArrays; i++) {
         uint8_t* array = arrays[i];
         if (array == NULL) continue;
-        int j = 0;
-        int offset = 0;
         // get the number of bits each value will be packed in
-        int width = getPackWidth(i);
-        while (true) {
-          // mask the bits left of the packed value
-          int value = (1 << width) - 1;
-          // the value is completely stored in entry j
-          if (offset + width <= size) {
-            // get the packed value
-            value &= array[j] >> size - width - offset;
-            offset += width;
-            if (offset >= size) {
-              offset %= size;
-              j += 1;
-            }
-          // the value is split between two or more entries, starting at j
-          } else {
-            int shift = width + offset - size;
-            value &= array[j++] << shift;
-            shift -= size;
-            while (shift > 0) {
-              value |= array[j++] << shift;
-              shift -= size;
-            }
-            if (shift == 0) {
-              value |= array[j++];
-              offset = 0;
-            // shift < 0
-            } else {
-              value |= array[j] >> -shift;
-              offset = size + shift;
-            }
-          }
-          if (value != 0) {
-            break;
-          }
+        int width = derived().getPackWidth(i);
+        uint64_t length = 0;
+        while (unpackValue(array, width, length) != 0) {
+          length++;
         }
-        memSize += j;
+        memSize += packedSize(width, length + 1);
       }
 
       return memSize;
     }
 
-    void setArray(int index, int* values, int length)
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
     {
       // get the number of bits each value will be packed in
-      int width = setPackWidth(index, values, length);
-
-      // compute the smallest uint8_t array that will hold all the bits
-      int n = ((width * length) + size - 1) / size;
-
-      // allocate and initialize the new array
-      uint8_t* array = arrays[index] = (uint8_t*) realloc(arrays[index], sizeof(uint8_t) * n);
-      if (array == NULL) {
-        throw std::bad_alloc();
-      }
-      for (int i = 0; i < n; i++) {
-        array[i] = 0;
-      }
+      int width = derived().setPackWidth(index, values, length);
 
-      // pack the new array
-      packArray(array, width, values, length);
+      setPackedArray(index, width, values, length);
     }
 
-    void clearArray(int index)
+    void clearArray(Symbol_T index)
     {
-      free(arrays[index]);
+      allocator.deallocate(arrays[index]);
       arrays[index] = NULL;
     }
 
-    int getValue(int index, int i)
+    Symbol_T getValue(Symbol_T index, Offset_T i)
     {
       uint8_t* array = arrays[index];
 
       // get the number of bits each value will be packed in
-      int width = getPackWidth(index);
+      int width = derived().getPackWidth(index);
 
       return unpackValue(array, width, i);
     }
 
-    virtual int setPackWidth(int index, int* values, int length) = 0;
-    virtual int getPackWidth(int index) = 0;
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      uint8_t* array = arrays[index];
+
+      // get the number of bits each value will be packed in
+      int width = derived().getPackWidth(index);
+
+      // the subarrays are terminated by a 0 and not padded, so the kernels may
+      // only read the bytes of the values up to the terminator
+      return unpackArrayTerminated(array, width, item, length, values);
+    }
 
 };
 
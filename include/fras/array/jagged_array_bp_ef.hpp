@@ -0,0 +1,140 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_EF
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_EF
+
+#include <algorithm>
+#include "fras/array/bit_packing.hpp"
+#include "fras/array/elias_fano_offsets.hpp"
+#include "fras/array/jagged_array.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace fras {
+
+/**
+ * A base class for bit packed jagged array implementations that store their
+ * subarrays back to back in one word-aligned bit stream without terminators.
+ * The bit offset of each subarray is stored out of band in EliasFanoOffsets,
+ * so offsets take a few bits per subarray and the length of a subarray is
+ * known without decoding it. The terminator is synthesized when a subarray is
+ * read past its end. Assumes subarrays are set in order and that the last
+ * subarray is set last. Like JaggedArrayBp, the Derived class provides the
+ * pack widths.
+ **/
+template <class Derived, class Symbol_T, class Offset_T>
+class JaggedArrayBpEF : public JaggedArray<Symbol_T, Offset_T>
+{
+  protected:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    uint8_t* buffer;
+    uint64_t capacity;
+    uint64_t numBits;
+
+    EliasFanoOffsets offsets;
+
+    void indexOffsets()
+    {
+      offsets.index();
+
+      // release the unused capacity, keeping the padding word
+      capacity = ((numBits + 7) >> 3) + sizeof(uint64_t);
+      buffer = (uint8_t*) realloc(buffer, sizeof(uint8_t) * capacity);
+      if (buffer == NULL) {
+        throw std::bad_alloc();
+      }
+    }
+
+  public:
+
+    JaggedArrayBpEF(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), buffer(NULL), capacity(0), numBits(0), offsets(numArrays) { }
+
+    ~JaggedArrayBpEF()
+    {
+      free(buffer);
+    }
+
+    uint64_t getMemSize()
+    {
+      return capacity * sizeof(uint8_t) + offsets.getMemSize();
+    }
+
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      // the terminator is not stored
+      if (length > 0 && values[length - 1] == 0) {
+        length--;
+      }
+
+      // get the number of bits each value will be packed in
+      int width = derived().setPackWidth(index, values, length);
+
+      // append the values to the stream, keeping a zeroed padding word
+      uint64_t n = ((numBits + (uint64_t) width * length + 7) >> 3) + sizeof(uint64_t);
+      if (n > capacity) {
+        uint64_t newCapacity = std::max(n, 2 * capacity);
+        buffer = (uint8_t*) realloc(buffer, sizeof(uint8_t) * newCapacity);
+        if (buffer == NULL) {
+          throw std::bad_alloc();
+        }
+        memset(buffer + capacity, 0, sizeof(uint8_t) * (newCapacity - capacity));
+        capacity = newCapacity;
+      }
+      packArrayWord(buffer, width, values, length, numBits);
+      numBits += (uint64_t) width * length;
+      offsets.append(index, numBits);
+
+      // index the offsets once the last subarray is set
+      if (index == numArrays - 1) {
+        indexOffsets();
+      }
+    }
+
+    // the stream is only ever freed as a whole
+    void clearArray(Symbol_T index) { }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      return (offsets.get(index + 1) - offsets.get(index)) / derived().getPackWidth(index);
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T i)
+    {
+      uint64_t begin = offsets.get(index);
+      uint64_t end = offsets.get(index + 1);
+
+      // get the number of bits each value will be packed in
+      int width = derived().getPackWidth(index);
+
+      uint64_t bit = begin + (uint64_t) i * width;
+      return (bit < end) ? unpackBits(buffer, bit, width) : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      uint64_t begin = offsets.get(index);
+      uint64_t end = offsets.get(index + 1);
+
+      // get the number of bits each value will be packed in
+      int width = derived().getPackWidth(index);
+
+      // decode the values and the terminator if the subarray ends first
+      Offset_T n = (end - begin) / width - item;
+      if (n < length) {
+        unpackArrayBits(buffer, begin + (uint64_t) item * width, width, n, values);
+        values[n] = 0;
+        return n + 1;
+      }
+      unpackArrayBits(buffer, begin + (uint64_t) item * width, width, length, values);
+      return length;
+    }
+
+};
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_FLAT
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_FLAT
+
+#include <algorithm>
+#include "fras/array/bit_packing.hpp"
+#include "fras/array/jagged_array.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace fras {
+
+/**
+ * A base class for bit packed jagged array implementations that store every
+ * subarray in a single contiguous buffer.
+ * Subarrays are addressed by their byte offsets in the buffer, which removes
+ * the per-subarray allocation and pointer of JaggedArrayBp. The buffer ends
+ * with a word of zeroed padding so values can be read with unaligned 64-bit
+ * loads. Assumes subarrays are set in order; subarrays that are skipped are
+ * empty. Like JaggedArrayBp, the Derived class provides the pack widths. The
+ * buffer and offsets are used in place when the array is loaded from a
+ * MappedFile.
+ **/
+template <class Derived, class Symbol_T, class Offset_T>
+class JaggedArrayBpFlat : public JaggedArray<Symbol_T, Offset_T>
+{
+  protected:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    uint8_t* buffer;
+    uint64_t capacity;
+
+    // offsets[i] is where subarray i starts and offsets[i + 1] is where it
+    // ends; these are byte offsets so they're 64-bit regardless of Offset_T
+    uint64_t* offsets;
+    Symbol_T nextIndex;
+
+    // whether the buffer and offsets point into a MappedFile
+    bool mapped;
+
+    // reserves n bytes plus the padding word
+    void reserve(uint64_t n)
+    {
+      n += sizeof(uint64_t);
+      if (n <= capacity) return;
+      capacity = std::max(n, 2 * capacity);
+      buffer = (uint8_t*) realloc(buffer, sizeof(uint8_t) * capacity);
+      if (buffer == NULL) {
+        throw std::bad_alloc();
+      }
+    }
+
+    // allocates n zeroed bytes at the end of the buffer for the given subarray
+    uint8_t* appendArray(Symbol_T index, uint64_t n)
+    {
+      if (index < nextIndex) {
+        throw std::runtime_error("flat jagged array subarrays must be set in order");
+      }
+
+      // skipped subarrays are empty
+      for (; nextIndex < index; nextIndex++) {
+        offsets[nextIndex + 1] = offsets[nextIndex];
+      }
+
+      // append the array
+      uint64_t begin = offsets[index];
+      reserve(begin + n);
+      uint8_t* array = buffer + begin;
+      memset(array, 0, sizeof(uint8_t) * (n + sizeof(uint64_t)));
+      offsets[index + 1] = begin + n;
+      nextIndex = index + 1;
+
+      // release the unused capacity once the last subarray is set
+      uint64_t end = offsets[nextIndex] + sizeof(uint64_t);
+      if (index == numArrays - 1 && capacity > end) {
+        capacity = end;
+        buffer = (uint8_t*) realloc(buffer, sizeof(uint8_t) * capacity);
+        if (buffer == NULL) {
+          throw std::bad_alloc();
+        }
+        array = buffer + begin;
+      }
+
+      return array;
+    }
+
+    // the number of values of the given width that fit in a subarray, which
+    // may include trailing zeros after the terminator
+    Offset_T numValues(Symbol_T index, int width)
+    {
+      return ((offsets[index + 1] - offsets[index]) * BP_CELL_SIZE) / width;
+    }
+
+  public:
+
+    // whether the values are packed with the word-aligned packing, which names
+    // the encodings of the derived classes
+    static constexpr bool WORD_ALIGNED = false;
+
+    JaggedArrayBpFlat(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), buffer(NULL), capacity(0), nextIndex(0), mapped(false)
+    {
+      offsets = new uint64_t[numArrays + 1];
+      offsets[0] = 0;
+    }
+
+    JaggedArrayBpFlat(MappedFile& file): JaggedArray<Symbol_T, Offset_T>(file), mapped(true)
+    {
+      nextIndex = file.readValue<Symbol_T>();
+      offsets = file.readArray<uint64_t>((uint64_t) numArrays + 1);
+      capacity = offsets[nextIndex] + sizeof(uint64_t);
+      buffer = file.readArray<uint8_t>(capacity);
+    }
+
+    ~JaggedArrayBpFlat()
+    {
+      if (mapped) return;
+      free(buffer);
+      delete[] offsets;
+    }
+
+    // writes the storage; the Derived class writes its pack widths after it
+    void serialize(std::ostream& out)
+    {
+      JaggedArray<Symbol_T, Offset_T>::serialize(out);
+      writeValue(out, nextIndex);
+      writeArray(out, offsets, (uint64_t) numArrays + 1);
+      writeArray(out, buffer, offsets[nextIndex] + sizeof(uint64_t));
+    }
+
+    uint64_t getMemSize()
+    {
+      return (offsets[nextIndex] + sizeof(uint64_t)) * sizeof(uint8_t) + (numArrays + 1) * sizeof(uint64_t);
+    }
+
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      // get the number of bits each value will be packed in
+      int width = derived().setPackWidth(index, values, length);
+
+      // pack the new array
+      uint8_t* array = appendArray(index, packedSize(width, length));
+      packArray(array, width, values, length);
+    }
+
+    // the buffer is only ever freed as a whole
+    void clearArray(Symbol_T index) { }
+
+    Symbol_T getValue(Symbol_T index, Offset_T i)
+    {
+      // get the number of bits each value will be packed in
+      int width = derived().getPackWidth(index);
+
+      return unpackValue(buffer + offsets[index], width, i);
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      // get the number of bits each value will be packed in
+      int width = derived().getPackWidth(index);
+
+      uint8_t* array = buffer + offsets[index];
+      length = std::min(length, numValues(index, width) - item);
+      // the buffer ends with a padding word, so the kernels may read past the
+      // subarray up to the end of the buffer
+      unpackArray(array, width, item, length, values, buffer + capacity);
+      return length;
+    }
+
+};
+
+}
+
+#endif
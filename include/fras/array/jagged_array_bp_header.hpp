@@ -0,0 +1,169 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_HEADER
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_HEADER
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "fras/array/bit_packing.hpp"
+#include "fras/array/jagged_array.hpp"
+#include "fras/array/subarray_allocator.hpp"
+
+namespace fras {
+
+/**
+ * Implements the jagged array interface using the optimal packing size for
+ * each subarray, like JaggedArrayBpOpt, but stores the packing size and the
+ * length of every subarray in a small header at the start of the subarray's
+ * own allocation. Reading a value therefore needs no lookup besides the
+ * subarray's pointer, and the header is usually in the same cache line as the
+ * values that follow it. Since the length is known, the terminator is not
+ * stored and is synthesized when a subarray is read past its end. Subarrays
+ * are allocated with the given Allocation, as in JaggedArrayBp.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayBpHeader : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    // the header's first byte holds the pack width minus 1 in its low bits and
+    // the base 2 log of the number of bytes the length is stored in in its
+    // high bits; the length follows in little-endian order
+    static const int WIDTH_BITS = 6;
+
+    SubarrayAllocator allocator;
+
+    uint8_t** arrays;
+
+    // the base 2 log of the number of bytes needed to store the length
+    static int lengthCode(Offset_T length)
+    {
+      if (length <= UINT8_MAX) return 0;
+      if (length <= UINT16_MAX) return 1;
+      if ((uint64_t) length <= UINT32_MAX) return 2;
+      return 3;
+    }
+
+    // reads a subarray's header and returns where its packed values start
+    static const uint8_t* readHeader(const uint8_t* array, int& width, Offset_T& length)
+    {
+      uint8_t header = array[0];
+      width = (header & ((1 << WIDTH_BITS) - 1)) + 1;
+      int lengthBytes = 1 << (header >> WIDTH_BITS);
+      uint64_t value = array[1];
+      for (int k = 1; k < lengthBytes; k++) {
+        value |= (uint64_t) array[1 + k] << (8 * k);
+      }
+      length = value;
+      return array + 1 + lengthBytes;
+    }
+
+  public:
+
+    // subarrays are allocated separately, so they can be set concurrently
+    static const bool CONCURRENT_SET = true;
+
+    JaggedArrayBpHeader(Symbol_T numArrays, Allocation allocation = Allocation::MALLOC): JaggedArray<Symbol_T, Offset_T>(numArrays), allocator(allocation)
+    {
+      // initialize the jagged array
+      arrays = new uint8_t*[numArrays];
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        arrays[i] = NULL;
+      }
+    }
+
+    ~JaggedArrayBpHeader()
+    {
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        allocator.deallocate(arrays[i]);
+      }
+      delete[] arrays;
+    }
+
+    uint64_t getMemSize()
+    {
+      uint64_t memSize = 0;
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        if (arrays[i] == NULL) continue;
+        int width;
+        Offset_T length;
+        const uint8_t* values = readHeader(arrays[i], width, length);
+        memSize += (values - arrays[i]) + packedSize(width, length);
+      }
+      return memSize;
+    }
+
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      // the terminator is not stored
+      if (length > 0 && values[length - 1] == 0) {
+        length--;
+      }
+
+      // get the number of bits each value will be packed in
+      int width = 1;
+      for (Offset_T i = 0; i < length; i++) {
+        width = std::max(width, msb(values[i]));
+      }
+
+      // allocate and initialize the new array
+      int code = lengthCode(length);
+      int lengthBytes = 1 << code;
+      std::size_t n = 1 + lengthBytes + packedSize(width, length);
+      allocator.deallocate(arrays[index]);
+      uint8_t* array = arrays[index] = (uint8_t*) allocator.allocate(sizeof(uint8_t) * n, alignof(uint8_t));
+      memset(array, 0, sizeof(uint8_t) * n);
+
+      // write the header and pack the new array
+      array[0] = (code << WIDTH_BITS) | (width - 1);
+      for (int k = 0; k < lengthBytes; k++) {
+        array[1 + k] = (uint64_t) length >> (8 * k);
+      }
+      packArray(array + 1 + lengthBytes, width, values, length);
+    }
+
+    void clearArray(Symbol_T index)
+    {
+      allocator.deallocate(arrays[index]);
+      arrays[index] = NULL;
+    }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      int width;
+      Offset_T length;
+      readHeader(arrays[index], width, length);
+      return length;
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      int width;
+      Offset_T length;
+      const uint8_t* values = readHeader(arrays[index], width, length);
+      return (item < length) ? unpackValue(values, width, item) : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      int width;
+      Offset_T arrayLength;
+      const uint8_t* array = readHeader(arrays[index], width, arrayLength);
+
+      // decode the values and the terminator if the subarray ends first
+      Offset_T n = std::min(length, arrayLength - item);
+      for (Offset_T i = 0; i < n; i++) {
+        values[i] = unpackValue(array, width, item + i);
+      }
+      if (n < length) {
+        values[n] = 0;
+        return n + 1;
+      }
+      return length;
+    }
+};
+
+}
+
+#endif
@@ -2,33 +2,57 @@
 #define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_INDEX
 
 #include "fras/array/jagged_array_bp.hpp"
+#include "fras/array/jagged_array_bp_ef.hpp"
+#include "fras/array/jagged_array_bp_flat.hpp"
+#include "fras/array/jagged_array_bp_word.hpp"
 
 namespace fras {
 
 /**
- * Implements the JaggedArrayBp abstract class using index-based bit packing.
+ * Implements the JaggedArrayBp base class using index-based bit packing.
  * Specifically, it is assumed that the values in every subarray will be less
  * than the subarray's index so the most significant bit of the index is used to
- * determine how many bits are used to pack each value in the subarray.
+ * determine how many bits are used to pack each value in the subarray. The
+ * JaggedArrayBp_T parameter selects the storage layout, e.g. JaggedArrayBp,
+ * JaggedArrayBpFlat, JaggedArrayBpWord, or JaggedArrayBpEF.
+ * Symbol_T and Offset_T are the value and length types, as in JaggedArray.
  **/
-class JaggedArrayBpIndex : public JaggedArrayBp
+template <template <class, class, class> class JaggedArrayBp_T = JaggedArrayBp, class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayBpIndex : public JaggedArrayBp_T<JaggedArrayBpIndex<JaggedArrayBp_T, Symbol_T, Offset_T>, Symbol_T, Offset_T>
 {
   private:
 
-    int setPackWidth(int index, int* values, int length)
+    typedef JaggedArrayBp_T<JaggedArrayBpIndex, Symbol_T, Offset_T> Base;
+
+    // the storage base class gets the pack widths from this class statically
+    friend Base;
+
+    int setPackWidth(Symbol_T index, Symbol_T* values, Offset_T length)
     {
       return getPackWidth(index);
     }
 
     // computes the max possible bit width of the index's values
-    int getPackWidth(int index)
+    int getPackWidth(Symbol_T index)
     {
       return msb(index - 1);
     }
 
   public:
 
-    JaggedArrayBpIndex(int numArrays): JaggedArrayBp(numArrays) { }
+    // the name the array is serialized under, for storage layouts that can be
+    // loaded from a MappedFile
+    static constexpr const char* ENCODING = Base::WORD_ALIGNED
+      ? (sizeof(Symbol_T) == sizeof(uint64_t) ? "wordbpleft64" : "wordbpleft")
+      : (sizeof(Symbol_T) == sizeof(uint64_t) ? "flatbpleft64" : "flatbpleft");
+
+    JaggedArrayBpIndex(Symbol_T numArrays): Base(numArrays) { }
+
+    // for storage layouts that allocate each subarray separately
+    JaggedArrayBpIndex(Symbol_T numArrays, Allocation allocation) requires std::constructible_from<Base, Symbol_T, Allocation>: Base(numArrays, allocation) { }
+
+    // for storage layouts that can be loaded from a MappedFile
+    JaggedArrayBpIndex(MappedFile& file) requires std::constructible_from<Base, MappedFile&>: Base(file) { }
 
 };
 
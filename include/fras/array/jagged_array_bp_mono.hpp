@@ -3,33 +3,57 @@
 
 #include <algorithm>
 #include "fras/array/jagged_array_bp.hpp"
+#include "fras/array/jagged_array_bp_ef.hpp"
+#include "fras/array/jagged_array_bp_flat.hpp"
+#include "fras/array/jagged_array_bp_word.hpp"
+#include "fras/array/parallel.hpp"
+#include <vector>
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/util.hpp>
 
 namespace fras {
 
 /**
- * Implements the JaggedArrayBp abstract class using a monotonic sequence of
- * packing sizes. Specifically, it computes the smallest bit width that a
- * subarray's values can be packed with and then packs them using that value or
- * the width of the preceeding subarray, whichever is larger. Assumes subarrays
- * are set in order.
+ * Implements the JaggedArrayBp base class using a monotonic sequence of packing
+ * sizes. Specifically, it computes the smallest bit width that a subarray's
+ * values can be packed with and then packs them using that value or the width of
+ * the preceeding subarray, whichever is larger. Assumes subarrays are set in
+ * order, or, with storage layouts that allocate each subarray separately, a
+ * range at a time from several threads with setArrays. The JaggedArrayBp_T parameter selects the storage layout, e.g.
+ * JaggedArrayBp, JaggedArrayBpFlat, JaggedArrayBpWord, or JaggedArrayBpEF.
+ * Symbol_T and Offset_T are the value and length types, as in JaggedArray.
  **/
-class JaggedArrayBpMono : public JaggedArrayBp
+template <template <class, class, class> class JaggedArrayBp_T = JaggedArrayBp, class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayBpMono : public JaggedArrayBp_T<JaggedArrayBpMono<JaggedArrayBp_T, Symbol_T, Offset_T>, Symbol_T, Offset_T>
 {
   private:
 
+    typedef JaggedArrayBp_T<JaggedArrayBpMono, Symbol_T, Offset_T> Base;
+
+    // the storage base class gets the pack widths from this class statically
+    friend Base;
+
     sdsl::sd_vector<> rulePackBitvector;
     sdsl::sd_vector<>::rank_1_type rulePackBitvectorRank;
 
     uint8_t* packSizes;  // no size will exceed 64
 
-    int setPackWidth(int index, int* values, int length)
+    // whether the pack sizes point into a MappedFile
+    bool mapped;
+
+    // the smallest width that all the values can be packed in
+    static int valuesWidth(Symbol_T* values, Offset_T length)
     {
       int width = 0;
-      for (int i = 0; i < length; i++) {
+      for (Offset_T i = 0; i < length; i++) {
         width = std::max(width, msb(values[i]));
       }
+      return width;
+    }
+
+    int setPackWidth(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      int width = valuesWidth(values, length);
       if (index > 0) {
         width = std::max(width, (int) packSizes[index - 1]);
       }
@@ -37,21 +61,21 @@ class JaggedArrayBpMono : public JaggedArrayBp
       return width;
     }
 
-    int getPackWidth(int index)
+    int getPackWidth(Symbol_T index)
     {
       // index+1 because rank is exclusive [0, index) and we want inclusive [0, index]
-      int r = rulePackBitvectorRank.rank(index + 1);
+      uint64_t r = rulePackBitvectorRank.rank(index + 1);
       return packSizes[r];
     }
 
     void indexPackSizes() {
       // create a bit vector for unique pack size positions
-      sdsl::bit_vector tmpRulePackBitvector(numArrays, 0);
+      sdsl::bit_vector tmpRulePackBitvector(this->numArrays, 0);
       //tmpRulePackBitvector[0] = 1;
 
       // compute the number of unique pack sizes and their locations
-      int uniqueWidths = 1;
-      for (int i = 1; i < numArrays; i++) {
+      uint64_t uniqueWidths = 1;
+      for (Symbol_T i = 1; i < this->numArrays; i++) {
         if (packSizes[i] != packSizes[i - 1]) {
           uniqueWidths += 1;
           tmpRulePackBitvector[i] = 1;
@@ -66,8 +90,8 @@ class JaggedArrayBpMono : public JaggedArrayBp
       // create the unique pack size array
       uint8_t* uniquePackSizes = new uint8_t[uniqueWidths];
       uniquePackSizes[0] = packSizes[0];
-      for (int i = 1; i < uniqueWidths; i++) {
-        int j = rulePackBitvectorSelect.select(i);
+      for (uint64_t i = 1; i < uniqueWidths; i++) {
+        uint64_t j = rulePackBitvectorSelect.select(i);
         uniquePackSizes[i] = packSizes[j];
       }
       delete[] packSizes;
@@ -76,32 +100,106 @@ class JaggedArrayBpMono : public JaggedArrayBp
 
   public:
 
-    JaggedArrayBpMono(int numArrays): JaggedArrayBp(numArrays)
+    // the name the array is serialized under, for storage layouts that can be
+    // loaded from a MappedFile
+    static constexpr const char* ENCODING = Base::WORD_ALIGNED
+      ? (sizeof(Symbol_T) == sizeof(uint64_t) ? "wordbpmono64" : "wordbpmono")
+      : (sizeof(Symbol_T) == sizeof(uint64_t) ? "flatbpmono64" : "flatbpmono");
+
+    // each pack width depends on the previous subarray's, so subarrays must be set in order
+    static const bool CONCURRENT_SET = false;
+
+    JaggedArrayBpMono(Symbol_T numArrays): Base(numArrays), packSizes(new uint8_t[numArrays]()), mapped(false) { }
+
+    // for storage layouts that allocate each subarray separately
+    JaggedArrayBpMono(Symbol_T numArrays, Allocation allocation) requires std::constructible_from<Base, Symbol_T, Allocation>: Base(numArrays, allocation), packSizes(new uint8_t[numArrays]()), mapped(false) { }
+
+    // for storage layouts that can be loaded from a MappedFile; the unique
+    // pack sizes are used in place and the sparse bit vector is copied
+    JaggedArrayBpMono(MappedFile& file) requires std::constructible_from<Base, MappedFile&>: Base(file), mapped(true)
     {
-      packSizes = new uint8_t[numArrays];
-      for (int i = 0; i < numArrays; i++) {
-        packSizes[i] = 0;
-      }
+      file.readStructure(rulePackBitvector);
+      rulePackBitvectorRank = sdsl::sd_vector<>::rank_1_type(&rulePackBitvector);
+      uint64_t uniqueWidths = file.readValue<uint64_t>();
+      packSizes = file.readArray<uint8_t>(uniqueWidths);
     }
 
     ~JaggedArrayBpMono()
     {
-      delete[] packSizes;
+      if (!mapped) {
+        delete[] packSizes;
+      }
+    }
+
+    void serialize(std::ostream& out) requires std::constructible_from<Base, MappedFile&>
+    {
+      Base::serialize(out);
+      writeStructure(out, rulePackBitvector);
+      // +1 for the first width, which has no bit set
+      uint64_t uniqueWidths = rulePackBitvectorRank.rank(rulePackBitvector.size()) + 1;
+      writeValue(out, uniqueWidths);
+      writeArray(out, packSizes, uniqueWidths);
     }
 
-    void setArray(int index, int* values, int length)
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
     {
-      JaggedArrayBp::setArray(index, values, length);
+      Base::setArray(index, values, length);
       // index the pack sizes if this is the last rule set
-      if (index == numArrays - 1) {
+      if (index == this->numArrays - 1) {
+        indexPackSizes();
+      }
+    }
+
+    // the widths are a prefix max of the subarrays' own widths, so they're
+    // computed with a parallel scan before any subarray is packed: the first
+    // pass stores every subarray's own width and the largest width in each
+    // thread's part, the width carried into each part is scanned from those,
+    // and the second pass carries it through the part while packing it
+    template <class Values>
+    void setArrays(Symbol_T begin, Symbol_T end, uint64_t threads, Values values) requires (Base::CONCURRENT_SET)
+    {
+      std::vector<uint8_t> carries(threads);
+      runInParallel(threads, [&](uint64_t thread) {
+        std::vector<Symbol_T> buffer;
+        Symbol_T first = partBegin(begin, end - begin, threads, thread);
+        Symbol_T last = partBegin(begin, end - begin, threads, thread + 1);
+        uint8_t largest = 0;
+        for (Symbol_T i = first; i < last; i++) {
+          values(i, buffer);
+          packSizes[i] = valuesWidth(buffer.data(), buffer.size());
+          largest = std::max(largest, packSizes[i]);
+        }
+        carries[thread] = largest;
+      });
+
+      // every part's carry is the largest width before it
+      uint8_t carry = (begin > 0) ? packSizes[begin - 1] : 0;
+      for (uint64_t thread = 0; thread < threads; thread++) {
+        uint8_t largest = carries[thread];
+        carries[thread] = carry;
+        carry = std::max(carry, largest);
+      }
+
+      runInParallel(threads, [&](uint64_t thread) {
+        std::vector<Symbol_T> buffer;
+        Symbol_T first = partBegin(begin, end - begin, threads, thread);
+        Symbol_T last = partBegin(begin, end - begin, threads, thread + 1);
+        uint8_t width = carries[thread];
+        for (Symbol_T i = first; i < last; i++) {
+          width = packSizes[i] = std::max(width, packSizes[i]);
+          values(i, buffer);
+          this->setPackedArray(i, width, buffer.data(), buffer.size());
+        }
+      });
+      if (end == this->numArrays) {
         indexPackSizes();
       }
     }
 
-    int getMemSize()
+    uint64_t getMemSize()
     {
-      int memSize = JaggedArrayBp::getMemSize();
-      int uniqueWidths = rulePackBitvectorRank.rank(rulePackBitvectorRank.size());
+      uint64_t memSize = Base::getMemSize();
+      uint64_t uniqueWidths = rulePackBitvectorRank.rank(rulePackBitvectorRank.size());
       memSize += uniqueWidths * sizeof(uint8_t);
       memSize += sdsl::size_in_bytes(rulePackBitvector);
       memSize += sdsl::size_in_bytes(rulePackBitvectorRank);
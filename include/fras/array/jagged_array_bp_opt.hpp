@@ -3,34 +3,60 @@
 
 #include <algorithm>
 #include "fras/array/jagged_array_bp.hpp"
+#include "fras/array/jagged_array_bp_ef.hpp"
+#include "fras/array/jagged_array_bp_flat.hpp"
+#include "fras/array/jagged_array_bp_word.hpp"
+#include "fras/array/parallel.hpp"
+#include <vector>
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/util.hpp>
 
 namespace fras {
 
 /**
- * Implements the JaggedArrayBp abstract class using the optimal packing size
- * for each subarray. Packing sizes themselves are stored in a packed array to
- * minimize space. Assumes the lsat subarray is set last.
+ * Implements the JaggedArrayBp base class using the optimal packing size for
+ * each subarray. Packing sizes themselves are stored in a packed array to
+ * minimize space. Assumes the lsat subarray is set last. With storage layouts
+ * that allocate each subarray separately, a range of subarrays can be set from
+ * several threads at once with setArrays. The JaggedArrayBp_T
+ * parameter selects the storage layout, e.g. JaggedArrayBp, JaggedArrayBpFlat,
+ * JaggedArrayBpWord, or JaggedArrayBpEF.
+ * Symbol_T and Offset_T are the value and length types, as in JaggedArray.
  **/
-class JaggedArrayBpOpt : public JaggedArrayBp
+template <template <class, class, class> class JaggedArrayBp_T = JaggedArrayBp, class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayBpOpt : public JaggedArrayBp_T<JaggedArrayBpOpt<JaggedArrayBp_T, Symbol_T, Offset_T>, Symbol_T, Offset_T>
 {
   private:
 
+    typedef JaggedArrayBp_T<JaggedArrayBpOpt, Symbol_T, Offset_T> Base;
+
+    // the storage base class gets the pack widths from this class statically
+    friend Base;
+
     uint8_t packSize;  // will not exceed 64
     uint8_t* packSizes;  // no size will exceed 64
 
-    int setPackWidth(int index, int* values, int length)
+    // whether the pack sizes point into a MappedFile
+    bool mapped;
+
+    // the smallest width that all the values can be packed in
+    static int valuesWidth(Symbol_T* values, Offset_T length)
     {
       int width = 0;
-      for (int i = 0; i < length; i++) {
+      for (Offset_T i = 0; i < length; i++) {
         width = std::max(width, msb(values[i]));
       }
+      return width;
+    }
+
+    int setPackWidth(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      int width = valuesWidth(values, length);
       packSizes[index] = width;
       return width;
     }
 
-    int getPackWidth(int index)
+    int getPackWidth(Symbol_T index)
     {
       // unpack the pack size
       return unpackValue(packSizes, packSize, index);
@@ -39,56 +65,95 @@ class JaggedArrayBpOpt : public JaggedArrayBp
     void indexPackSizes() {
       // compute the number of unique pack sizes and their locations
       packSize = 0;
-      int* unpackedSizes = new int[numArrays];
-      for (int i = 0; i < numArrays; i++) {
+      uint8_t* unpackedSizes = new uint8_t[this->numArrays];
+      for (Symbol_T i = 0; i < this->numArrays; i++) {
         packSize = std::max(packSize, packSizes[i]);
-        unpackedSizes[i] = (int) packSizes[i];
+        unpackedSizes[i] = packSizes[i];
       }
 
       // created the packed packSize array
-      int n = ((packSize * numArrays) + size - 1) / size;
+      std::size_t n = packedSize(packSize, this->numArrays);
       packSizes = (uint8_t*) realloc(packSizes, sizeof(uint8_t) * n);
       if (packSizes == NULL) {
         throw std::bad_alloc();
       }
-      for (int i = 0; i < n; i++) {
+      for (std::size_t i = 0; i < n; i++) {
         packSizes[i] = 0;
       }
 
       // pack the new array
-      packArray(packSizes, packSize, unpackedSizes, numArrays);
+      packArray(packSizes, packSize, unpackedSizes, this->numArrays);
 
       delete[] unpackedSizes;
     }
 
   public:
 
-    JaggedArrayBpOpt(int numArrays): JaggedArrayBp(numArrays)
+    // the name the array is serialized under, for storage layouts that can be
+    // loaded from a MappedFile
+    static constexpr const char* ENCODING = Base::WORD_ALIGNED
+      ? (sizeof(Symbol_T) == sizeof(uint64_t) ? "wordbpright64" : "wordbpright")
+      : (sizeof(Symbol_T) == sizeof(uint64_t) ? "flatbpright64" : "flatbpright");
+
+    JaggedArrayBpOpt(Symbol_T numArrays): Base(numArrays), packSizes(new uint8_t[numArrays]()), mapped(false) { }
+
+    // for storage layouts that allocate each subarray separately
+    JaggedArrayBpOpt(Symbol_T numArrays, Allocation allocation) requires std::constructible_from<Base, Symbol_T, Allocation>: Base(numArrays, allocation), packSizes(new uint8_t[numArrays]()), mapped(false) { }
+
+    // for storage layouts that can be loaded from a MappedFile; the packed
+    // pack sizes are used in place
+    JaggedArrayBpOpt(MappedFile& file) requires std::constructible_from<Base, MappedFile&>: Base(file), mapped(true)
     {
-      packSizes = new uint8_t[numArrays];
-      for (int i = 0; i < numArrays; i++) {
-        packSizes[i] = 0;
-      }
+      packSize = file.readValue<uint8_t>();
+      packSizes = file.readArray<uint8_t>(packedSize(packSize, this->numArrays));
     }
 
     ~JaggedArrayBpOpt()
     {
-      delete[] packSizes;
+      if (!mapped) {
+        delete[] packSizes;
+      }
+    }
+
+    void serialize(std::ostream& out) requires std::constructible_from<Base, MappedFile&>
+    {
+      Base::serialize(out);
+      writeValue(out, packSize);
+      writeArray(out, packSizes, packedSize(packSize, this->numArrays));
     }
 
-    void setArray(int index, int* values, int length)
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
     {
-      JaggedArrayBp::setArray(index, values, length);
+      Base::setArray(index, values, length);
       // index the pack sizes if this is the last rule set
-      if (index == numArrays - 1) {
+      if (index == this->numArrays - 1) {
+        indexPackSizes();
+      }
+    }
+
+    // every subarray's width only depends on its own values, so the threads
+    // pack each subarray as soon as they've filled it
+    template <class Values>
+    void setArrays(Symbol_T begin, Symbol_T end, uint64_t threads, Values values) requires (Base::CONCURRENT_SET)
+    {
+      runInParallel(threads, [&](uint64_t thread) {
+        std::vector<Symbol_T> buffer;
+        Symbol_T first = partBegin(begin, end - begin, threads, thread);
+        Symbol_T last = partBegin(begin, end - begin, threads, thread + 1);
+        for (Symbol_T i = first; i < last; i++) {
+          values(i, buffer);
+          Base::setArray(i, buffer.data(), buffer.size());
+        }
+      });
+      if (end == this->numArrays) {
         indexPackSizes();
       }
     }
 
-    int getMemSize()
+    uint64_t getMemSize()
     {
-      int memSize = JaggedArrayBp::getMemSize();
-      int n = ((packSize * numArrays) + size - 1) / size;
+      uint64_t memSize = Base::getMemSize();
+      std::size_t n = packedSize(packSize, this->numArrays);
       memSize += n * sizeof(uint8_t);
       return memSize;
     }
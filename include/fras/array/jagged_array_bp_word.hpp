@@ -0,0 +1,61 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_WORD
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_BP_WORD
+
+#include <algorithm>
+#include "fras/array/bit_packing.hpp"
+#include "fras/array/jagged_array_bp_flat.hpp"
+
+namespace fras {
+
+/**
+ * A base class for bit packed jagged array implementations that use the
+ * word-aligned packing from bit_packing.hpp.
+ * Subarrays are stored in the contiguous buffer of JaggedArrayBpFlat, whose
+ * trailing padding lets every value be read with a single unaligned 64-bit
+ * load, a shift, and a mask, i.e. without loops or branches. Runs of values
+ * are decoded with the SIMD kernel in unpackArrayWord.
+ **/
+template <class Derived, class Symbol_T, class Offset_T>
+class JaggedArrayBpWord : public JaggedArrayBpFlat<Derived, Symbol_T, Offset_T>
+{
+  public:
+
+    static constexpr bool WORD_ALIGNED = true;
+
+    JaggedArrayBpWord(Symbol_T numArrays): JaggedArrayBpFlat<Derived, Symbol_T, Offset_T>(numArrays) { }
+
+    JaggedArrayBpWord(MappedFile& file): JaggedArrayBpFlat<Derived, Symbol_T, Offset_T>(file) { }
+
+    void setArray(Symbol_T index, Symbol_T* values, Offset_T length)
+    {
+      // get the number of bits each value will be packed in
+      int width = this->derived().setPackWidth(index, values, length);
+
+      // pack the new array
+      uint8_t* array = this->appendArray(index, packedSize(width, length));
+      packArrayWord(array, width, values, length);
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T i)
+    {
+      // get the number of bits each value will be packed in
+      int width = this->derived().getPackWidth(index);
+
+      return unpackValueWord(this->buffer + this->offsets[index], width, i);
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      // get the number of bits each value will be packed in
+      int width = this->derived().getPackWidth(index);
+
+      length = std::min(length, this->numValues(index, width) - item);
+      unpackArrayWord(this->buffer + this->offsets[index], width, item, length, values);
+      return length;
+    }
+
+};
+
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_DAC
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_DAC
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "fras/array/elias_fano_offsets.hpp"
+#include "fras/array/jagged_array.hpp"
+#include <sdsl/dac_vector.hpp>
+#include <sdsl/util.hpp>
+
+namespace fras {
+
+/**
+ * Implements the jagged array interface using directly addressable codes
+ * (DACs). The subarrays are stored back to back without terminators in one
+ * sdsl dac_vector_dp, which splits every value into variable-length chunks
+ * whose level widths are chosen to minimize the total size, so that small
+ * values take few bits but any value can still be read in constant time. Like
+ * JaggedArrayIntEF, the subarray offsets are stored in EliasFanoOffsets and
+ * the terminator is synthesized when a subarray is read past its end. Assumes
+ * subarrays are set in order and that the last subarray is set last.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayDac : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    // the values of the subarrays until they're encoded
+    std::vector<Symbol_T> tmpValues;
+
+    sdsl::dac_vector_dp<> values;
+
+    EliasFanoOffsets offsets;
+
+    void encodeValues()
+    {
+      offsets.index();
+      values = sdsl::dac_vector_dp<>(tmpValues);
+      std::vector<Symbol_T>().swap(tmpValues);
+    }
+
+  public:
+
+    JaggedArrayDac(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), offsets(numArrays) { }
+
+    uint64_t getMemSize()
+    {
+      return sdsl::size_in_bytes(values) + offsets.getMemSize();
+    }
+
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
+    {
+      // the terminator is not stored
+      if (length > 0 && array[length - 1] == 0) {
+        length--;
+      }
+
+      tmpValues.insert(tmpValues.end(), array, array + length);
+      offsets.append(index, tmpValues.size());
+
+      // encode the values once the last subarray is set
+      if (index == numArrays - 1) {
+        encodeValues();
+      }
+    }
+
+    // the values are only ever freed as a whole
+    void clearArray(Symbol_T index) { }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      return offsets.get(index + 1) - offsets.get(index);
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      uint64_t begin = offsets.get(index);
+      uint64_t end = offsets.get(index + 1);
+      return (begin + item < end) ? values[begin + item] : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      uint64_t begin = offsets.get(index) + item;
+      uint64_t end = offsets.get(index + 1);
+
+      // decode the values and the terminator if the subarray ends first
+      Offset_T n = std::min((uint64_t) length, end - begin);
+      for (Offset_T i = 0; i < n; i++) {
+        values[i] = this->values[begin + i];
+      }
+      if (n < length) {
+        values[n] = 0;
+        return n + 1;
+      }
+      return length;
+    }
+};
+
+}
+
+#endif
@@ -2,75 +2,92 @@
 #define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_INT
 
 #include <cstddef>
-#include <cstdlib>
-#include <malloc.h>
-#include <new>
+#include <cstdint>
 #include "fras/array/jagged_array.hpp"
+#include "fras/array/subarray_allocator.hpp"
 
 namespace fras {
 
-/** Implements the jagged array abstract class using int arrays. */
-class JaggedArrayInt : public JaggedArray
+/**
+ * Implements the jagged array interface using an array per subarray. The
+ * arrays are allocated with the given Allocation.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayInt : public JaggedArray<Symbol_T, Offset_T>
 {
   private:
 
-    int** arrays;
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    SubarrayAllocator allocator;
+
+    Symbol_T** arrays;
 
   public:
 
-    JaggedArrayInt(int numArrays): JaggedArray(numArrays)
+    // subarrays are allocated separately, so they can be set concurrently
+    static const bool CONCURRENT_SET = true;
+
+    JaggedArrayInt(Symbol_T numArrays, Allocation allocation = Allocation::MALLOC): JaggedArray<Symbol_T, Offset_T>(numArrays), allocator(allocation)
     {
       // initialize the jagged array
-      arrays = new int*[numArrays];
-      for (int i = 0; i < numArrays; i++) {
+      arrays = new Symbol_T*[numArrays];
+      for (Symbol_T i = 0; i < numArrays; i++) {
         arrays[i] = NULL;
       }
     };
 
     ~JaggedArrayInt()
     {
-      for (int i = 0; i < numArrays; i++) {
-        free(arrays[i]);
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        allocator.deallocate(arrays[i]);
       }
       delete[] arrays;
     }
 
-    int getMemSize() {
-      int memSize = 0;
-      for (int i = 0; i < numArrays; i++) {
-        int* array = arrays[i];
+    uint64_t getMemSize() {
+      uint64_t memSize = 0;
+      for (Symbol_T i = 0; i < numArrays; i++) {
+        Symbol_T* array = arrays[i];
         if (array == NULL) continue;
-        int j = 0;
+        uint64_t j = 0;
         while (true) {
-          uint8_t value = array[j++];
+          Symbol_T value = array[j++];
           if (value == 0) break;
         }
-        memSize += sizeof(int) * j;
+        memSize += sizeof(Symbol_T) * j;
       }
       return memSize;
     }
 
-    void setArray(int index, int* array, int length)
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
     {
-      arrays[index] = (int*) realloc(arrays[index], sizeof(int) * length);
-      if (arrays[index] == NULL) {
-        throw std::bad_alloc();
-      }
-      for (int i = 0; i < length; i++) {
+      allocator.deallocate(arrays[index]);
+      arrays[index] = (Symbol_T*) allocator.allocate(sizeof(Symbol_T) * length, alignof(Symbol_T));
+      for (Offset_T i = 0; i < length; i++) {
         arrays[index][i] = array[i];
       }
     }
 
-    void clearArray(int index)
+    void clearArray(Symbol_T index)
     {
-      free(arrays[index]);
+      allocator.deallocate(arrays[index]);
       arrays[index] = NULL;
     }
 
-    int getValue(int index, int item)
+    Symbol_T getValue(Symbol_T index, Offset_T item)
     {
       return arrays[index][item];
     }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      Symbol_T* array = arrays[index] + item;
+      for (Offset_T i = 0; i < length; i++) {
+        if ((values[i] = array[i]) == 0) return i + 1;
+      }
+      return length;
+    }
 };
 
 }
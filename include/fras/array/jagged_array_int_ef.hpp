@@ -0,0 +1,119 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_INT_EF
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_INT_EF
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "fras/array/elias_fano_offsets.hpp"
+#include "fras/array/jagged_array.hpp"
+
+namespace fras {
+
+/**
+ * Implements the jagged array interface using a single contiguous buffer that
+ * stores the subarrays without terminators. Like JaggedArrayBpEF, the
+ * subarray offsets are stored in EliasFanoOffsets and the terminator is
+ * synthesized when a subarray is read past its end. Assumes subarrays are set
+ * in order and that the last subarray is set last.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayIntEF : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Symbol_T* buffer;
+    uint64_t capacity;
+    uint64_t size;
+
+    EliasFanoOffsets offsets;
+
+    void indexOffsets()
+    {
+      offsets.index();
+
+      // release the unused capacity
+      capacity = std::max(size, (uint64_t) 1);
+      buffer = (Symbol_T*) realloc(buffer, sizeof(Symbol_T) * capacity);
+      if (buffer == NULL) {
+        throw std::bad_alloc();
+      }
+    }
+
+  public:
+
+    JaggedArrayIntEF(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), buffer(NULL), capacity(0), size(0), offsets(numArrays) { }
+
+    ~JaggedArrayIntEF()
+    {
+      free(buffer);
+    }
+
+    uint64_t getMemSize()
+    {
+      return size * sizeof(Symbol_T) + offsets.getMemSize();
+    }
+
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
+    {
+      // the terminator is not stored
+      if (length > 0 && array[length - 1] == 0) {
+        length--;
+      }
+
+      // append the subarray
+      if (size + length > capacity) {
+        capacity = std::max(size + length, 2 * capacity);
+        buffer = (Symbol_T*) realloc(buffer, sizeof(Symbol_T) * capacity);
+        if (buffer == NULL) {
+          throw std::bad_alloc();
+        }
+      }
+      memcpy(buffer + size, array, sizeof(Symbol_T) * length);
+      size += length;
+      offsets.append(index, size);
+
+      // index the offsets once the last subarray is set
+      if (index == numArrays - 1) {
+        indexOffsets();
+      }
+    }
+
+    // the buffer is only ever freed as a whole
+    void clearArray(Symbol_T index) { }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      return offsets.get(index + 1) - offsets.get(index);
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      uint64_t begin = offsets.get(index);
+      uint64_t end = offsets.get(index + 1);
+      return (begin + item < end) ? buffer[begin + item] : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      uint64_t begin = offsets.get(index) + item;
+      uint64_t end = offsets.get(index + 1);
+
+      // copy the values and the terminator if the subarray ends first
+      Offset_T n = end - begin;
+      if (n < length) {
+        memcpy(values, buffer + begin, sizeof(Symbol_T) * n);
+        values[n] = 0;
+        return n + 1;
+      }
+      memcpy(values, buffer + begin, sizeof(Symbol_T) * length);
+      return length;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_INT_FLAT
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_INT_FLAT
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include "fras/array/jagged_array.hpp"
+
+namespace fras {
+
+/**
+ * Implements the jagged array interface using a single contiguous
+ * buffer that is addressed by subarray offsets. Assumes subarrays are set in
+ * order; subarrays that are skipped are empty. The buffer and offsets are used
+ * in place when the array is loaded from a MappedFile.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayIntFlat : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Symbol_T* buffer;
+    uint64_t capacity;
+
+    // offsets[i] is where subarray i starts and offsets[i + 1] is where it ends
+    Offset_T* offsets;
+    Symbol_T nextIndex;
+
+    // whether the buffer and offsets point into a MappedFile
+    bool mapped;
+
+    void reserve(uint64_t n)
+    {
+      if (n <= capacity) return;
+      capacity = std::max(n, 2 * capacity);
+      buffer = (Symbol_T*) realloc(buffer, sizeof(Symbol_T) * capacity);
+      if (buffer == NULL) {
+        throw std::bad_alloc();
+      }
+    }
+
+  public:
+
+    // the name the array is serialized under
+    static constexpr const char* ENCODING = (sizeof(Symbol_T) == sizeof(uint64_t)) ? "flatarray64" : "flatarray";
+
+    JaggedArrayIntFlat(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), buffer(NULL), capacity(0), nextIndex(0), mapped(false)
+    {
+      offsets = new Offset_T[numArrays + 1];
+      offsets[0] = 0;
+    }
+
+    JaggedArrayIntFlat(MappedFile& file): JaggedArray<Symbol_T, Offset_T>(file), mapped(true)
+    {
+      nextIndex = file.readValue<Symbol_T>();
+      offsets = file.readArray<Offset_T>((uint64_t) numArrays + 1);
+      capacity = offsets[nextIndex];
+      buffer = file.readArray<Symbol_T>(capacity);
+    }
+
+    ~JaggedArrayIntFlat()
+    {
+      if (mapped) return;
+      free(buffer);
+      delete[] offsets;
+    }
+
+    void serialize(std::ostream& out)
+    {
+      JaggedArray<Symbol_T, Offset_T>::serialize(out);
+      writeValue(out, nextIndex);
+      writeArray(out, offsets, (uint64_t) numArrays + 1);
+      writeArray(out, buffer, offsets[nextIndex]);
+    }
+
+    uint64_t getMemSize()
+    {
+      return (uint64_t) offsets[nextIndex] * sizeof(Symbol_T) + ((uint64_t) numArrays + 1) * sizeof(Offset_T);
+    }
+
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
+    {
+      if (index < nextIndex) {
+        throw std::runtime_error("flat jagged array subarrays must be set in order");
+      }
+
+      // skipped subarrays are empty
+      for (; nextIndex < index; nextIndex++) {
+        offsets[nextIndex + 1] = offsets[nextIndex];
+      }
+
+      // append the subarray
+      Offset_T begin = offsets[index];
+      reserve((uint64_t) begin + length);
+      for (Offset_T i = 0; i < length; i++) {
+        buffer[begin + i] = array[i];
+      }
+      offsets[index + 1] = begin + length;
+      nextIndex = index + 1;
+
+      // release the unused capacity once the last subarray is set
+      if (index == numArrays - 1 && capacity > offsets[numArrays]) {
+        capacity = offsets[numArrays];
+        buffer = (Symbol_T*) realloc(buffer, sizeof(Symbol_T) * std::max(capacity, (uint64_t) 1));
+        if (buffer == NULL) {
+          throw std::bad_alloc();
+        }
+      }
+    }
+
+    // the buffer is only ever freed as a whole
+    void clearArray(Symbol_T index) { }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      // every non-empty subarray ends with a terminator
+      Offset_T length = offsets[index + 1] - offsets[index];
+      return (length == 0) ? 0 : length - 1;
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      return buffer[offsets[index] + item];
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      Offset_T begin = offsets[index] + item;
+      length = std::min(length, (Offset_T) (offsets[index + 1] - begin));
+      memcpy(values, buffer + begin, sizeof(Symbol_T) * length);
+      return length;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_PAIR
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_PAIR
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include "fras/array/jagged_array.hpp"
+
+namespace fras {
+
+/**
+ * Implements the jagged array interface for grammars whose subarrays are all
+ * pairs, e.g. RePair grammars, except for the last subarray, i.e. the start
+ * rule. Pairs are stored in one flat array with no terminator and the last
+ * subarray is stored separately. Reading the item after a pair returns the 0
+ * terminator so the array can be used like any other jagged array, and
+ * getPair returns both values of a pair at once. Both arrays are used in place
+ * when the array is loaded from a MappedFile.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayPair : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    Symbol_T* pairs;
+    Symbol_T* last;
+    Offset_T lastLength;
+
+    // whether the arrays point into a MappedFile
+    bool mapped;
+
+  public:
+
+    // the name the array is serialized under
+    static constexpr const char* ENCODING = (sizeof(Symbol_T) == sizeof(uint64_t)) ? "pair64" : "pair";
+
+    // every pair has its own slots, so pairs can be set concurrently
+    static const bool CONCURRENT_SET = true;
+
+    JaggedArrayPair(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), last(NULL), lastLength(0), mapped(false)
+    {
+      pairs = new Symbol_T[2 * ((uint64_t) numArrays - 1)];
+    }
+
+    JaggedArrayPair(MappedFile& file): JaggedArray<Symbol_T, Offset_T>(file), mapped(true)
+    {
+      lastLength = file.readValue<Offset_T>();
+      pairs = file.readArray<Symbol_T>(2 * ((uint64_t) numArrays - 1));
+      last = file.readArray<Symbol_T>(lastLength);
+    }
+
+    ~JaggedArrayPair()
+    {
+      if (mapped) return;
+      delete[] pairs;
+      free(last);
+    }
+
+    void serialize(std::ostream& out)
+    {
+      JaggedArray<Symbol_T, Offset_T>::serialize(out);
+      writeValue(out, lastLength);
+      writeArray(out, pairs, 2 * ((uint64_t) numArrays - 1));
+      writeArray(out, last, lastLength);
+    }
+
+    uint64_t getMemSize()
+    {
+      return sizeof(Symbol_T) * 2 * ((uint64_t) numArrays - 1) + sizeof(Symbol_T) * (uint64_t) lastLength;
+    }
+
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
+    {
+      // the last subarray can be any length
+      if (index == numArrays - 1) {
+        last = (Symbol_T*) realloc(last, sizeof(Symbol_T) * length);
+        if (last == NULL) {
+          throw std::bad_alloc();
+        }
+        memcpy(last, array, sizeof(Symbol_T) * length);
+        lastLength = length;
+        return;
+      }
+      // every other subarray must be a pair, optionally followed by a terminator
+      if (length < 2 || length > 3 || (length == 3 && array[2] != 0)) {
+        throw std::runtime_error("pair encodings require every rule but the start rule to be a pair");
+      }
+      pairs[2 * (uint64_t) index] = array[0];
+      pairs[2 * (uint64_t) index + 1] = array[1];
+    }
+
+    void clearArray(Symbol_T index)
+    {
+      if (index == numArrays - 1) {
+        free(last);
+        last = NULL;
+        lastLength = 0;
+      }
+    }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      if (index == numArrays - 1) {
+        return (lastLength > 0 && last[lastLength - 1] == 0) ? lastLength - 1 : lastLength;
+      }
+      return 2;
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      if (index == numArrays - 1) return last[item];
+      return (item < 2) ? pairs[2 * (uint64_t) index + item] : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      if (index == numArrays - 1) {
+        length = std::min(length, (Offset_T) (lastLength - item));
+        memcpy(values, last + item, sizeof(Symbol_T) * length);
+        return length;
+      }
+      length = std::min(length, (Offset_T) (3 - item));
+      for (Offset_T i = 0; i < length; i++) {
+        values[i] = getValue(index, item + i);
+      }
+      return length;
+    }
+
+    void getPair(Symbol_T index, Symbol_T& left, Symbol_T& right)
+    {
+      left = pairs[2 * (uint64_t) index];
+      right = pairs[2 * (uint64_t) index + 1];
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_PAIR_BP
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_PAIR_BP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include "fras/array/bit_packing.hpp"
+#include "fras/array/jagged_array.hpp"
+
+namespace fras {
+
+/**
+ * A bit packed version of JaggedArrayPair. Every value is less than the
+ * number of subarrays, so all the pairs and the last subarray are packed
+ * with a single global width using the word-aligned packing from
+ * bit_packing.hpp, i.e. the values of a pair are adjacent in memory. Both
+ * arrays are used in place when the array is loaded from a MappedFile.
+ **/
+template <class Symbol_T = uint32_t, class Offset_T = Symbol_T>
+class JaggedArrayPairBp : public JaggedArray<Symbol_T, Offset_T>
+{
+  private:
+
+    using JaggedArray<Symbol_T, Offset_T>::numArrays;
+
+    int width;
+    uint8_t* pairs;
+    uint8_t* last;
+    Offset_T lastLength;
+
+    // whether the arrays point into a MappedFile
+    bool mapped;
+
+    // allocates a zeroed array for length values plus the padding word
+    uint8_t* allocate(uint8_t* array, uint64_t length)
+    {
+      std::size_t n = packedSize(width, length) + sizeof(uint64_t);
+      array = (uint8_t*) realloc(array, sizeof(uint8_t) * n);
+      if (array == NULL) {
+        throw std::bad_alloc();
+      }
+      memset(array, 0, sizeof(uint8_t) * n);
+      return array;
+    }
+
+  public:
+
+    // the name the array is serialized under
+    static constexpr const char* ENCODING = (sizeof(Symbol_T) == sizeof(uint64_t)) ? "bppair64" : "bppair";
+
+    JaggedArrayPairBp(Symbol_T numArrays): JaggedArray<Symbol_T, Offset_T>(numArrays), last(NULL), lastLength(0), mapped(false)
+    {
+      width = msb(numArrays - 1);
+      pairs = allocate(NULL, 2 * ((uint64_t) numArrays - 1));
+    }
+
+    JaggedArrayPairBp(MappedFile& file): JaggedArray<Symbol_T, Offset_T>(file), mapped(true)
+    {
+      width = msb(numArrays - 1);
+      lastLength = file.readValue<Offset_T>();
+      pairs = file.readArray<uint8_t>(packedSize(width, 2 * ((uint64_t) numArrays - 1)) + sizeof(uint64_t));
+      last = file.readArray<uint8_t>(packedSize(width, lastLength) + sizeof(uint64_t));
+    }
+
+    ~JaggedArrayPairBp()
+    {
+      if (mapped) return;
+      free(pairs);
+      free(last);
+    }
+
+    // the arrays are written with their padding words
+    void serialize(std::ostream& out)
+    {
+      JaggedArray<Symbol_T, Offset_T>::serialize(out);
+      writeValue(out, lastLength);
+      writeArray(out, pairs, packedSize(width, 2 * ((uint64_t) numArrays - 1)) + sizeof(uint64_t));
+      writeArray(out, last, packedSize(width, lastLength) + sizeof(uint64_t));
+    }
+
+    uint64_t getMemSize()
+    {
+      return packedSize(width, 2 * ((uint64_t) numArrays - 1)) + packedSize(width, lastLength) + 2 * sizeof(uint64_t);
+    }
+
+    void setArray(Symbol_T index, Symbol_T* array, Offset_T length)
+    {
+      // the last subarray can be any length
+      if (index == numArrays - 1) {
+        last = allocate(last, length);
+        packArrayWord(last, width, array, length);
+        lastLength = length;
+        return;
+      }
+      // every other subarray must be a pair, optionally followed by a terminator
+      if (length < 2 || length > 3 || (length == 3 && array[2] != 0)) {
+        throw std::runtime_error("pair encodings require every rule but the start rule to be a pair");
+      }
+      // values are masked in since a pair may be set more than once
+      for (int i = 0; i < 2; i++) {
+        uint64_t bit = ((uint64_t) 2 * index + i) * width;
+        uint8_t* cell = pairs + (bit >> 3);
+        uint64_t mask = (((uint64_t) 1 << width) - 1) << (bit & 7);
+        storeWord(cell, (loadWord(cell) & ~mask) | ((uint64_t) array[i] << (bit & 7)));
+      }
+    }
+
+    void clearArray(Symbol_T index)
+    {
+      if (index == numArrays - 1) {
+        free(last);
+        last = NULL;
+        lastLength = 0;
+      }
+    }
+
+    Offset_T getLength(Symbol_T index)
+    {
+      if (index == numArrays - 1) {
+        return (lastLength > 0 && unpackValueWord(last, width, lastLength - 1) == 0) ? lastLength - 1 : lastLength;
+      }
+      return 2;
+    }
+
+    Symbol_T getValue(Symbol_T index, Offset_T item)
+    {
+      if (index == numArrays - 1) return unpackValueWord(last, width, item);
+      return (item < 2) ? unpackValueWord(pairs, width, 2 * (uint64_t) index + item) : 0;
+    }
+
+    Offset_T getValues(Symbol_T index, Offset_T item, Offset_T length, Symbol_T* values)
+    {
+      if (index == numArrays - 1) {
+        length = std::min(length, (Offset_T) (lastLength - item));
+        unpackArrayWord(last, width, item, length, values);
+        return length;
+      }
+      length = std::min(length, (Offset_T) (3 - item));
+      for (Offset_T i = 0; i < length; i++) {
+        values[i] = getValue(index, item + i);
+      }
+      return length;
+    }
+
+    void getPair(Symbol_T index, Symbol_T& left, Symbol_T& right)
+    {
+      left = unpackValueWord(pairs, width, 2 * (uint64_t) index);
+      right = unpackValueWord(pairs, width, 2 * (uint64_t) index + 1);
+    }
+};
+
+}
+
+#endif
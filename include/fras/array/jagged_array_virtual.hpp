@@ -0,0 +1,39 @@
+#ifndef INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_VIRTUAL
+#define INCLUDED_FRAS_ARRAY_JAGGED_ARRAY_VIRTUAL
+
+#include "fras/array/jagged_array.hpp"
+
+namespace fras {
+
+/**
+ * Wraps a jagged array so that its methods are dispatched virtually, which is
+ * how jagged arrays were accessed before they were resolved statically. This
+ * is only used to benchmark the cost of dynamic dispatch.
+ **/
+template <JaggedArrayType JaggedArray_T>
+class JaggedArrayVirtual
+{
+  private:
+
+    JaggedArray_T array;
+
+  public:
+
+    typedef typename JaggedArray_T::Symbol Symbol;
+    typedef typename JaggedArray_T::Offset Offset;
+
+    JaggedArrayVirtual(Symbol numArrays): array(numArrays) { }
+    virtual ~JaggedArrayVirtual() { }
+
+    virtual void setArray(Symbol index, Symbol* values, Offset length) { array.setArray(index, values, length); }
+    virtual void clearArray(Symbol index) { array.clearArray(index); }
+    virtual Symbol getValue(Symbol index, Offset item) { return array.getValue(index, item); }
+    virtual Offset getValues(Symbol index, Offset item, Offset length, Symbol* values) { return array.getValues(index, item, length, values); }
+
+    virtual const Symbol& getNumArrays() const { return array.getNumArrays(); }
+    virtual uint64_t getMemSize() { return array.getMemSize(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef INCLUDED_FRAS_ARRAY_MAPPED_FILE
+#define INCLUDED_FRAS_ARRAY_MAPPED_FILE
+
+#include <cstdint>
+#include <fcntl.h>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fras {
+
+/**
+ * Routines for writing serialized files. Every value and array is padded to a
+ * multiple of 8 bytes so that everything in a mapped file is aligned for its
+ * type.
+ **/
+
+const uint64_t SERIALIZED_ALIGNMENT = sizeof(uint64_t);
+
+inline uint64_t serializedSize(uint64_t bytes)
+{
+  return (bytes + SERIALIZED_ALIGNMENT - 1) & ~(SERIALIZED_ALIGNMENT - 1);
+}
+
+template <class T>
+inline void writeArray(std::ostream& out, const T* values, uint64_t length)
+{
+  static const char padding[SERIALIZED_ALIGNMENT] = { };
+  uint64_t bytes = sizeof(T) * length;
+  if (bytes > 0) {
+    out.write((const char*) values, bytes);
+  }
+  out.write(padding, serializedSize(bytes) - bytes);
+}
+
+template <class T>
+inline void writeValue(std::ostream& out, T value)
+{
+  writeArray(out, &value, 1);
+}
+
+// writes a structure that can only be serialized to a stream, e.g. an sdsl
+// structure, preceded by its size in bytes
+template <class T>
+inline void writeStructure(std::ostream& out, const T& structure)
+{
+  std::ostringstream buffer;
+  structure.serialize(buffer);
+  std::string bytes = buffer.str();
+  writeValue<uint64_t>(out, bytes.size());
+  writeArray(out, bytes.data(), bytes.size());
+}
+
+/**
+ * A file that is mapped into memory and read in order through a cursor, or
+ * parsed as a whole, e.g. a text grammar. Arrays are returned as pointers into
+ * the mapping so that they can be used in place instead of being copied. The
+ * mapping is read-only, so every process that maps the same file shares the
+ * same page cache pages, and a stray write through a pointer into the mapping
+ * faults instead of silently giving the process a private copy of the page.
+ * Anything that points into the mapping must not outlive the MappedFile.
+ **/
+class MappedFile
+{
+  private:
+
+    // a read-only stream buffer over bytes in the mapping
+    class MemoryBuffer : public std::streambuf
+    {
+      public:
+
+        MemoryBuffer(char* bytes, uint64_t length)
+        {
+          setg(bytes, bytes, bytes + length);
+        }
+    };
+
+    uint8_t* data;
+    uint64_t size;
+    uint64_t position;
+
+  public:
+
+    MappedFile(std::string filename): data(NULL), size(0), position(0)
+    {
+      int fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw std::runtime_error("failed to open " + filename);
+      }
+      struct stat s;
+      if (fstat(fd, &s) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat " + filename);
+      }
+      size = s.st_size;
+      if (size > 0) {
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+          close(fd);
+          throw std::runtime_error("failed to map " + filename);
+        }
+        data = (uint8_t*) mapping;
+      }
+      close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+      if (data != NULL) {
+        munmap(data, size);
+      }
+    }
+
+    // the whole mapping, for files that are parsed rather than read with the cursor
+    const char* getData() const { return (const char*) data; }
+    const uint64_t& getSize() const { return size; }
+
+    // returns the array of length values at the cursor and moves the cursor past it
+    template <class T>
+    T* readArray(uint64_t length)
+    {
+      uint64_t bytes = serializedSize(sizeof(T) * length);
+      if (bytes > size - position) {
+        throw std::runtime_error("the serialized file is truncated");
+      }
+      T* values = (T*) (data + position);
+      position += bytes;
+      return values;
+    }
+
+    template <class T>
+    T readValue()
+    {
+      return *readArray<T>(1);
+    }
+
+    // loads a structure written with writeStructure; the structure is copied
+    template <class T>
+    void readStructure(T& structure)
+    {
+      uint64_t length = readValue<uint64_t>();
+      MemoryBuffer buffer(readArray<char>(length), length);
+      std::istream in(&buffer);
+      structure.load(in);
+    }
+};
+
+}
+
+#endif
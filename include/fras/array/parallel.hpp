@@ -0,0 +1,60 @@
+#ifndef INCLUDED_FRAS_ARRAY_PARALLEL
+#define INCLUDED_FRAS_ARRAY_PARALLEL
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace fras {
+
+/**
+ * Routines for splitting work between threads, e.g. while a grammar is loaded
+ * and its jagged array is built.
+ **/
+
+// calls task(i) for every i in [0, numTasks), each on its own thread, and
+// rethrows the first exception any of them threw
+template <class Task>
+inline void runInParallel(uint64_t numTasks, Task task)
+{
+  if (numTasks == 1) {
+    task(0);
+    return;
+  }
+  std::vector<std::exception_ptr> errors(numTasks);
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < numTasks; i++) {
+    threads.emplace_back([&, i]() {
+      try {
+        task(i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr& error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+}
+
+// the number of threads to split work between so that each does at least minWork
+inline uint64_t numThreads(uint64_t work, uint64_t minWork)
+{
+  uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+  return std::max((uint64_t) 1, std::min(threads, work / minWork));
+}
+
+// the first item of part i when numItems items from begin are split into numParts parts
+inline uint64_t partBegin(uint64_t begin, uint64_t numItems, uint64_t numParts, uint64_t i)
+{
+  return begin + numItems * i / numParts;
+}
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef INCLUDED_FRAS_ARRAY_SUBARRAY_ALLOCATOR
+#define INCLUDED_FRAS_ARRAY_SUBARRAY_ALLOCATOR
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+namespace fras {
+
+/** How a jagged array allocates its subarrays. */
+enum class Allocation
+{
+  // every subarray is allocated and freed with malloc and free
+  MALLOC,
+  // subarrays are bump allocated from large chunks that are only freed with the array
+  ARENA,
+  // like ARENA but the chunks are backed by huge pages when the system allows it
+  HUGE_PAGE_ARENA
+};
+
+inline const char* allocationName(Allocation allocation)
+{
+  switch (allocation) {
+    case Allocation::ARENA: return "arena";
+    case Allocation::HUGE_PAGE_ARENA: return "huge page arena";
+    default: return "malloc";
+  }
+}
+
+/**
+ * Allocates the subarrays of a single jagged array. With an arena, subarrays
+ * are packed back to back in chunks mapped with mmap, which avoids the
+ * per-allocation overhead and fragmentation of malloc and keeps subarrays that
+ * are set one after the other close in memory. Deallocating a subarray is a
+ * no-op; the chunks are unmapped when the allocator is destroyed. Huge page
+ * chunks are mapped with MAP_HUGETLB if huge pages are reserved and otherwise
+ * aligned to the huge page size and advised with MADV_HUGEPAGE so that
+ * transparent huge pages can back them.
+ **/
+class SubarrayAllocator
+{
+  private:
+
+    // the size of a huge page on x86-64 and the smallest chunk size
+    static constexpr std::size_t HUGE_PAGE_SIZE = (std::size_t) 1 << 21;
+
+    // chunks double in size up to this size so there are few of them
+    static constexpr std::size_t MAX_CHUNK_SIZE = (std::size_t) 1 << 30;
+
+    Allocation allocation;
+
+    // the address and size of every chunk mapped
+    std::vector<std::pair<uint8_t*, std::size_t>> chunks;
+
+    uint8_t* next;
+    std::size_t remaining;
+
+    // maps an anonymous region of the given size that starts on a huge page boundary
+    static uint8_t* mapAligned(std::size_t size)
+    {
+      std::size_t padded = size + HUGE_PAGE_SIZE;
+      void* region = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (region == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+
+      // unmap the unaligned head and the tail
+      uintptr_t address = (uintptr_t) region;
+      uintptr_t aligned = (address + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+      if (aligned > address) {
+        munmap(region, aligned - address);
+      }
+      std::size_t tail = (address + padded) - (aligned + size);
+      if (tail > 0) {
+        munmap((void*) (aligned + size), tail);
+      }
+
+      return (uint8_t*) aligned;
+    }
+
+    void newChunk(std::size_t n)
+    {
+      std::size_t size = chunks.empty() ? HUGE_PAGE_SIZE : std::min(2 * chunks.back().second, MAX_CHUNK_SIZE);
+      size = std::max(size, (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+
+      void* chunk = MAP_FAILED;
+      if (allocation == Allocation::HUGE_PAGE_ARENA) {
+#ifdef MAP_HUGETLB
+        chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (chunk == MAP_FAILED) {
+          chunk = mapAligned(size);
+#ifdef MADV_HUGEPAGE
+          madvise(chunk, size, MADV_HUGEPAGE);
+#endif
+        }
+      } else {
+        chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+          throw std::bad_alloc();
+        }
+      }
+
+      chunks.emplace_back((uint8_t*) chunk, size);
+      next = (uint8_t*) chunk;
+      remaining = size;
+    }
+
+  public:
+
+    SubarrayAllocator(Allocation allocation = Allocation::MALLOC): allocation(allocation), next(NULL), remaining(0) { }
+
+    SubarrayAllocator(const SubarrayAllocator&) = delete;
+    SubarrayAllocator& operator=(const SubarrayAllocator&) = delete;
+
+    ~SubarrayAllocator()
+    {
+      for (auto& [chunk, size] : chunks) {
+        munmap(chunk, size);
+      }
+    }
+
+    const Allocation& getAllocation() const { return allocation; }
+
+    // allocates n bytes with the given alignment, which must be a power of 2
+    void* allocate(std::size_t n, std::size_t alignment)
+    {
+      if (allocation == Allocation::MALLOC) {
+        void* p = malloc(n);
+        if (p == NULL && n > 0) {
+          throw std::bad_alloc();
+        }
+        return p;
+      }
+
+      std::size_t padding = (alignment - ((uintptr_t) next & (alignment - 1))) & (alignment - 1);
+      if (padding + n > remaining) {
+        newChunk(n);
+        padding = 0;
+      }
+      uint8_t* p = next + padding;
+      next = p + n;
+      remaining -= padding + n;
+      return p;
+    }
+
+    void deallocate(void* p)
+    {
+      if (allocation == Allocation::MALLOC) {
+        free(p);
+      }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef INCLUDED_FRAS_CFG_BLOCK_CACHE
+#define INCLUDED_FRAS_CFG_BLOCK_CACHE
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "fras/cfg/random_access.hpp"
+
+namespace fras {
+
+/**
+ * A size-bounded cache of decoded text blocks in front of a random access
+ * index, for workloads that query the same regions of the text over and over.
+ * The text is split into aligned blocks of blockSize characters; a query
+ * copies the blocks it overlaps from the cache and decodes the rest of the
+ * range with the index. A block that misses is only decoded whole and added
+ * to the cache if it was queried before, and once the cache is full, only if
+ * it was queried more often lately than the block it would evict and the
+ * cache's hits saved decoding at least as many characters as the block has.
+ * So ranges that are queried once cost about as much as without the cache,
+ * and a cache too small for the hot blocks keeps some of them instead of
+ * evicting them for one another. The block to evict is
+ * picked with the clock policy: every block has a bit that's set when it's
+ * read, and the clock hand clears the bits it passes until it finds a block
+ * whose bit is clear, so a block is only evicted if it wasn't read since the
+ * hand last passed it. The blocks are split into shards by their number,
+ * each with its own lock, clock, and query counts, so threads can query the
+ * cache at once.
+ **/
+template <class CFG_T>
+class BlockCache
+{
+    public:
+
+        /**
+         * The query context of a thread, which holds the context its misses
+         * are decoded with and the buffer blocks are decoded into before
+         * they're added to the cache.
+         **/
+        class Context
+        {
+            friend class BlockCache;
+
+            private:
+
+                typename RandomAccess<CFG_T>::Context index;
+                std::vector<char> block;
+
+            public:
+
+                Context(CFG_T* cfg): index(cfg) { }
+        };
+
+    private:
+
+        // the most shards the blocks are split into, and the fewest slots a
+        // shard has unless the cache has fewer
+        static constexpr uint64_t NUM_SHARDS = 16;
+        static constexpr uint64_t MIN_SHARD_SLOTS = 16;
+
+        static constexpr uint64_t NO_BLOCK = UINT64_MAX;
+
+        // the number of query counters per slot, and the number of queries
+        // per slot after which a shard's counters are halved
+        static constexpr uint64_t FREQUENCIES_PER_SLOT = 4;
+        static constexpr uint64_t AGING_PERIOD = 10;
+
+        struct Shard
+        {
+            std::mutex mutex;
+            // the slot of every block in the shard, the block in every slot,
+            // and whether every slot was read since the hand last passed it
+            std::unordered_map<uint64_t, uint64_t> slots;
+            std::vector<uint64_t> blocks;
+            std::vector<uint8_t> referenced;
+            // how often the blocks were queried lately; every block has two
+            // counters picked by its number, which other blocks share, and
+            // the smaller one is the block's count. The counters are halved
+            // every few queries so that blocks that were hot a while ago make
+            // way for the blocks that are hot now
+            std::vector<uint8_t> frequencies;
+            uint64_t queries = 0;
+            // the characters the shard's hits copied instead of decoding,
+            // less the blocks that were decoded to replace other blocks, up
+            // to the shard's size; a block only replaces another if the hits
+            // have paid for it, so replacing blocks never decodes many more
+            // characters than the cache saves
+            uint64_t credit = 0;
+            // the shard's slots start at data, blockSize characters apart
+            char* data;
+            uint64_t hand = 0;
+        };
+
+        const RandomAccess<CFG_T>& index;
+        uint64_t textLength;
+        uint64_t blockSize;
+
+        std::vector<char> data;
+        uint64_t numShards;
+        uint64_t slotsPerShard;
+        std::unique_ptr<Shard[]> shards;
+
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+
+        Shard& shard(uint64_t block) const
+        {
+            return shards[(block * 0x9e3779b97f4a7c15 >> 32) % numShards];
+        }
+
+        // how often a block was queried lately
+        uint8_t frequency(const Shard& shard, uint64_t block) const;
+        // counts a query of a block and returns how often it was queried lately
+        uint8_t countQuery(Shard& shard, uint64_t block);
+        // moves the clock hand to the slot to evict next
+        uint64_t nextVictim(Shard& shard);
+
+        // copies [begin, end) of a block into out if it's cached; the block is
+        // marked as read, and otherwise admit is whether to add it
+        bool copyBlock(uint64_t block, char* out, uint64_t begin, uint64_t end, bool& admit);
+        // adds a decoded block unless another thread already did, evicting a block if the shard is full
+        void addBlock(uint64_t block, const char* characters);
+
+    public:
+
+        /**
+         * @param cfg The grammar of the index.
+         * @param index The index to decode the blocks that aren't cached with.
+         * @param maxBytes The most memory the cached blocks can use; a cache with less than one block decodes every query with the index.
+         * @param blockSize The number of characters in a block.
+         */
+        BlockCache(CFG_T* cfg, const RandomAccess<CFG_T>& index, uint64_t maxBytes, uint64_t blockSize = 4096);
+
+        BlockCache(const BlockCache&) = delete;
+        BlockCache& operator=(const BlockCache&) = delete;
+
+        /**
+          * Gets a substring in the original string; like RandomAccess::get,
+          * end - begin characters are written to out.
+          *
+          * @param context The context of the calling thread, which decodes the ranges that aren't cached.
+          * @param out The buffer to write the substring to.
+          * @param begin The start position of the substring in the original string.
+          * @param end The end position of the substring in the original string.
+          */
+        void get(Context& context, char* out, uint64_t begin, uint64_t end);
+
+        // the number of blocks that queries read from the cache and missed
+        uint64_t getHits() const { return hits.load(std::memory_order_relaxed); }
+        uint64_t getMisses() const { return misses.load(std::memory_order_relaxed); }
+        void resetCounters() { hits = 0; misses = 0; }
+
+        uint64_t getBlockSize() const { return blockSize; }
+        uint64_t getNumSlots() const { return numShards * slotsPerShard; }
+
+        // the memory of the blocks, the slots, and the query counters, not counting the hash maps' nodes
+        uint64_t memSize() const
+        {
+            return data.size() + (sizeof(uint64_t) + 1 + FREQUENCIES_PER_SLOT) * getNumSlots() + sizeof(Shard) * numShards;
+        }
+};
+
+}
+
+#endif
@@ -1,100 +1,285 @@
 #ifndef INCLUDED_FRAS_CFG_CFG
 #define INCLUDED_FRAS_CFG_CFG
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
+#include "fras/array/jagged_array.hpp"
+#include "fras/array/mapped_file.hpp"
 
 namespace fras {
 
-/** Parses different grammar-compressed CFGs into a naive encoding. */
-template <class JaggedArray_T>
+/**
+ * Parses different grammar-compressed CFGs into a naive encoding. Characters
+ * are stored as the jagged array's Symbol type and rule lengths as its Offset
+ * type, so compact grammars can use 32-bit types and huge grammars 64-bit
+ * types.
+ **/
+template <JaggedArrayType JaggedArray_T>
 class CFG
 {
 
+public:
+
+    typedef typename JaggedArray_T::Symbol Symbol;
+    typedef typename JaggedArray_T::Offset Offset;
+
+    /**
+     * The expansion size of every rule, i.e. the length of the text it expands
+     * to, including the characters and the start rule. Rules are ordered by
+     * expansion size, so only the first rule of every distinct size is stored.
+     **/
+    struct ExpansionSizes
+    {
+        std::vector<Symbol> firstRules;
+        std::vector<uint64_t> sizes;
+
+        // adds the size of the rules from rule on unless it's the previous rule's size
+        void add(Symbol rule, uint64_t size)
+        {
+            if (sizes.empty() || size != sizes.back()) {
+                firstRules.push_back(rule);
+                sizes.push_back(size);
+            }
+        }
+
+        uint64_t get(Symbol rule) const
+        {
+            return sizes[std::upper_bound(firstRules.begin(), firstRules.end(), rule) - firstRules.begin() - 1];
+        }
+    };
+
 private:
 
     uint64_t textLength = 0;
     JaggedArray_T* rules;
-    int numRules;
-    int rulesSize = 0;
-    int startRule;
-    int startSize = 0;
-    int depth = 0;
+    Symbol numRules;
+    Offset rulesSize = 0;
+    Symbol startRule;
+    Offset startSize = 0;
+    Symbol depth = 0;
+    Allocation allocation;
+
+    // the file the rules point into if the grammar was loaded from a serialized file
+    std::shared_ptr<MappedFile> file;
+
+    // the expansion size and reference count of every rule from when the
+    // grammar was loaded; empty once they're taken
+    ExpansionSizes expansionSizes;
+    std::vector<Symbol> referenceCounts;
+
+    // a grammar's rules as they're loaded, before they're reordered and
+    // encoded: the characters of every rule from ALPHABET_SIZE to the start
+    // rule back to back, without dummy codes, and where each rule begins. Pair
+    // grammars leave begins empty since every rule but the start rule is a pair
+    struct RawRules
+    {
+        std::vector<Symbol> characters;
+        std::vector<uint64_t> begins;
+
+        // where rule ALPHABET_SIZE + i begins, or the end of the start rule if i is numRules + 1
+        uint64_t begin(uint64_t i, uint64_t numRules) const
+        {
+            if (!begins.empty()) return begins[i];
+            return (i <= numRules) ? 2 * i : characters.size();
+        }
+    };
+
+    // the rules are created by postProcess once the grammar has been loaded
+    CFG(Symbol numRules, Allocation allocation): rules(NULL), numRules(numRules), startRule(numRules + CFG::ALPHABET_SIZE), allocation(allocation) { }
 
-    void setRule(JaggedArray_T* rules, int rule, int* characters, int length)
+    // creates a jagged array for the rules that uses the grammar's allocation if the array supports it
+    JaggedArray_T* createRules(Symbol numArrays)
+    {
+        if constexpr (AllocationJaggedArrayType<JaggedArray_T>) {
+            return new JaggedArray_T(numArrays, allocation);
+        } else {
+            return new JaggedArray_T(numArrays);
+        }
+    }
+
+    void setRule(JaggedArray_T* rules, Symbol rule, Symbol* characters, Offset length)
     {
         rules->setArray(rule, characters, length);
     }
-    void setRule(int rule, int* characters, int length)
+    void setRule(Symbol rule, Symbol* characters, Offset length)
     {
         setRule(this->rules, rule, characters, length);
     }
 
-    void clearRule(JaggedArray_T* rules, int rule)
+    void clearRule(JaggedArray_T* rules, Symbol rule)
     {
         rules->clearArray(rule);
     }
-    void setRule(int rule)
+    void setRule(Symbol rule)
     {
         clearRule(this->rules, rule);
     }
 
-    void computeDepthAndTextSize(uint64_t* ruleSizes, int* ruleDepths, int rule);
-    void reorderRules(uint64_t* ruleSizes);
-    void postProcess();
+    // parses the integers between begin and end in an MR-RePair file; the -1
+    // that ends each rule becomes the dummy code
+    static void parseMrRepairChunk(const char* begin, const char* end, std::vector<Symbol>& values);
+
+    // remaps the symbols of a Navarro grammar, i.e. ints, to this grammar's
+    // alphabet in a single branch-free pass that the compiler can vectorize;
+    // the symbols may be unaligned
+    static void remapNavarroSymbols(const char* symbols, uint64_t length, const unsigned char* map, int alphabetSize, Symbol* values);
+
+    // throws if a grammar's rules or sizes don't fit in the Symbol and Offset types
+    static void checkSizes(uint64_t numRules, uint64_t rulesSize, uint64_t startSize);
+
+    // computes the expansion size, depth and reference count of every rule in
+    // an iterative bottom-up pass that runs in parallel; characters(rule,
+    // visit) calls visit with each character of the rule until it returns false
+    template <class Characters>
+    void computeRuleStatistics(Characters characters, uint64_t* ruleSizes, Symbol* ruleDepths, Symbol* ruleReferences);
+    // computes the statistics of the encoded rules, e.g. of a serialized grammar
+    void computeRuleStatistics();
+    // computes the new ordering and the expansion sizes in the new ordering
+    void reorderRules(uint64_t* ruleSizes, Symbol* newOrdering, Symbol* newOrderingReversed);
+    void encodeRules(RawRules& raw, Symbol* newOrdering, Symbol* newOrderingReversed);
+    // computes the depth and text length of the loaded rules and encodes them,
+    // ordered by expansion length; the raw rules are freed
+    void postProcess(RawRules& raw);
 
 public:
 
-    static const int ALPHABET_SIZE = 256;
+    static const Symbol ALPHABET_SIZE = 256;
+
+    static const Symbol DUMMY_CODE = 0;
 
-    static const int DUMMY_CODE = 0;
+    // whether the rules, other than the start rule, are pairs that can be read with getPair
+    static constexpr bool PAIR_RULES = PairJaggedArrayType<JaggedArray_T>;
+
+    // whether rule lengths are stored out of band, i.e. ruleLength doesn't scan the rule
+    static constexpr bool RULE_LENGTHS = LengthJaggedArrayType<JaggedArray_T>;
+
+    // whether the grammar can be serialized and loaded with fromSerializedFile
+    static constexpr bool SERIALIZABLE = SerializableJaggedArrayType<JaggedArray_T>;
+
+    // the version of the serialized format, which changes whenever the format does
+    static const uint32_t SERIALIZATION_VERSION = 2;
 
     /**
      * Loads an MR-Repair grammar from a file.
      *
      * @param filename The file to load the grammar from.
+     * @param allocation How the rules are allocated, if the encoding allocates each rule separately.
      * @return The grammar that was loaded.
      * @throws Exception if the file cannot be read.
      */
-    static CFG* fromMrRepairFile(std::string filename);
+    static CFG* fromMrRepairFile(std::string filename, Allocation allocation = Allocation::MALLOC);
 
     /**
      * Loads a grammar from Navarro files.
      *
      * @param filenameC The grammar's C file.
      * @param filenameR The grammar's R file.
+     * @param allocation How the rules are allocated, if the encoding allocates each rule separately.
      * @return The grammar that was loaded.
      * @throws Exception if the files cannot be read.
      */
-    static CFG* fromNavarroFiles(std::string filenameC, std::string filenameR);
+    static CFG* fromNavarroFiles(std::string filenameC, std::string filenameR, Allocation allocation = Allocation::MALLOC);
 
     /**
      * Loads a grammar from Big-Repair files.
      *
      * @param filenameC The grammar's C file.
      * @param filenameR The grammar's R file.
+     * @param allocation How the rules are allocated, if the encoding allocates each rule separately.
      * @return The grammar that was loaded.
      * @throws Exception if the files cannot be read.
      */
-    static CFG* fromBigRepairFiles(std::string filenameC, std::string filenameR);
+    static CFG* fromBigRepairFiles(std::string filenameC, std::string filenameR, Allocation allocation = Allocation::MALLOC);
+
+    /**
+     * Builds a RePair grammar from a text file with RePair, in parallel, so
+     * the grammar doesn't have to be built with another tool and written to
+     * files first.
+     *
+     * @param filename The text file, which can't have 0 bytes.
+     * @param allocation How the rules are allocated, if the encoding allocates each rule separately.
+     * @return The grammar that was built.
+     * @throws Exception if the file cannot be read or has a 0 byte.
+     */
+    static CFG* fromTextFile(std::string filename, Allocation allocation = Allocation::MALLOC);
+
+    /**
+     * Loads a grammar that was written with serialize from a mapped file. The
+     * rules are used in place where the encoding allows it, so starting up
+     * doesn't parse or post-process the grammar and processes that map the
+     * same file share its pages. Anything else written after the grammar,
+     * e.g. a random access index, can be read from the file afterwards.
+     *
+     * @param file The mapped file, positioned at the start of the grammar.
+     * @return The grammar that was loaded.
+     * @throws Exception if the file isn't a grammar serialized with this
+     *         version and encoding.
+     */
+    static CFG* fromSerializedFile(std::shared_ptr<MappedFile> file) requires SERIALIZABLE;
+
+    /**
+     * Writes the grammar in a versioned binary format that can be loaded with
+     * fromSerializedFile.
+     *
+     * @param out The binary stream to write the grammar to.
+     */
+    void serialize(std::ostream& out) requires SERIALIZABLE;
 
-    CFG(int numRules): numRules(numRules), startRule(numRules + CFG::ALPHABET_SIZE)
-    {
-        rules = new JaggedArray_T(numRules + CFG::ALPHABET_SIZE + 1);
-    }
     ~CFG() { delete rules; };
 
-    int get(std::size_t i, std::size_t j) { return rules->getValue(i, j); }
+    Symbol get(Symbol i, Offset j) { return rules->getValue(i, j); }
+    // decodes up to length characters of rule i, starting at j, stopping after the dummy code
+    Offset get(Symbol i, Offset j, Offset length, Symbol* characters) { return rules->getValues(i, j, length, characters); }
+    // the number of characters in rule i, not including the dummy code
+    Offset ruleLength(Symbol i)
+    {
+        if constexpr (RULE_LENGTHS) {
+            return rules->getLength(i);
+        } else {
+            Offset length = 0;
+            while (get(i, length) != DUMMY_CODE) length++;
+            return length;
+        }
+    }
+    // gets both characters of pair rule i
+    void getPair(Symbol i, Symbol& left, Symbol& right) requires PAIR_RULES { rules->getPair(i, left, right); }
 
     const uint64_t& getTextLength() const { return textLength; }
-    const int& getNumRules() const { return numRules; }
-    const int& getRulesSize() const { return rulesSize; }
-    const int& getStartRule() const { return startRule; }
-    const int& getStartSize() const { return startSize; }
-    const int getTotalSize() const { return startSize + rulesSize; }
-    const int& getDepth() const { return depth; }
-
-    int memSize() { return rules->getMemSize(); }
+    const Symbol& getNumRules() const { return numRules; }
+    const Offset& getRulesSize() const { return rulesSize; }
+    const Symbol& getStartRule() const { return startRule; }
+    const Offset& getStartSize() const { return startSize; }
+    const uint64_t getTotalSize() const { return (uint64_t) startSize + rulesSize; }
+    const Symbol& getDepth() const { return depth; }
+
+    uint64_t memSize() { return rules->getMemSize(); }
+
+    /**
+     * Hands over the expansion sizes of the rules. They're computed while the
+     * grammar is loaded, or by this method if they weren't, e.g. for
+     * serialized grammars, so that random access indexes don't compute them
+     * again.
+     *
+     * @return The expansion sizes of the characters and rules, including the start rule.
+     */
+    ExpansionSizes takeExpansionSizes();
+
+    /**
+     * Hands over the number of times every rule occurs in the other rules,
+     * including the start rule, indexed by rule; characters aren't counted.
+     *
+     * @return The reference counts of the characters and rules.
+     */
+    std::vector<Symbol> takeReferenceCounts();
+
+private:
+
+    // reads the grammar that follows the header of a serialized file
+    CFG(std::shared_ptr<MappedFile> file) requires (SERIALIZABLE);
 
 };
 
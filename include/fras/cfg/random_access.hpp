@@ -1,9 +1,12 @@
 #ifndef INCLUDED_FRAS_CFG_RANDOM_ACCESS
 #define INCLUDED_FRAS_CFG_RANDOM_ACCESS
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <memory>
 #include <ostream>
-#include <stack>
+#include <vector>
 
 namespace fras {
 
@@ -11,12 +14,117 @@ namespace fras {
 template <class CFG_T>
 class RandomAccess
 {
+    public:
+
+        typedef typename CFG_T::Symbol Symbol;
+        typedef typename CFG_T::Offset Offset;
+
+    private:
+
+        // the number of characters decoded from a rule at a time
+        static const Offset BLOCK_SIZE = 16;
+
+    public:
+
+        class Cursor;
+
+        /**
+         * The descent stack of a query. The index itself is read-only while
+         * it's queried, so threads can query the same index at once as long
+         * as every thread has its own context.
+         **/
+        class Context
+        {
+            friend class RandomAccess;
+            friend class Cursor;
+
+            private:
+
+                // each level holds a rule, the index of the next character to
+                // read in the rule, a block of decoded characters that starts
+                // at blockIndexStack[level] and has blockSizeStack[level]
+                // characters, and the text position the rule's expansion
+                // starts at, which only cursors use
+                Symbol* ruleStack;
+                Offset* indexStack;
+                Offset* blockIndexStack;
+                Offset* blockSizeStack;
+                Symbol* blockStack;
+                uint64_t* positionStack;
+
+            public:
+
+                Context(CFG_T* cfg)
+                {
+                    // the start rule plus a level for every non-terminal below it
+                    Symbol depth = cfg->getDepth();
+                    ruleStack = new Symbol[depth];
+                    indexStack = new Offset[depth];
+                    blockIndexStack = new Offset[depth];
+                    blockSizeStack = new Offset[depth];
+                    blockStack = new Symbol[(uint64_t) depth * BLOCK_SIZE];
+                    positionStack = new uint64_t[depth];
+                }
+
+                Context(const Context&) = delete;
+                Context& operator=(const Context&) = delete;
+
+                ~Context()
+                {
+                    delete[] ruleStack;
+                    delete[] indexStack;
+                    delete[] blockIndexStack;
+                    delete[] blockSizeStack;
+                    delete[] blockStack;
+                    delete[] positionStack;
+                }
+        };
+
     private:
-        std::stack<int> ruleStack;
-        std::stack<int> indexStack;
 
-        virtual void rankSelect(uint64_t i, int& rank, uint64_t& select) = 0;
-        virtual uint64_t expansionSize(int rule) = 0;
+        // the context of get without one
+        Context context;
+
+        // the expansions of the rules before cacheEnd, back to back; rule c's
+        // expansion starts at cacheOffsets[c - ALPHABET_SIZE]
+        Symbol cacheEnd;
+        std::vector<char> cache;
+        std::vector<uint64_t> cacheOffsets;
+
+        // the expansion size of a non-terminal, which is read from the cache if it's there
+        uint64_t ruleSize(Symbol rule) const
+        {
+            if (rule < cacheEnd) {
+                return cacheOffsets[rule - CFG_T::ALPHABET_SIZE + 1] - cacheOffsets[rule - CFG_T::ALPHABET_SIZE];
+            }
+            return expansionSize(rule);
+        }
+
+        // every BLOCK_SIZE-th character of the rules with more than
+        // sampleLength characters is sampled with the offset of its expansion
+        // in the rule's expansion, so that a descent jumps to the block of the
+        // character it's looking for instead of scanning the rule. The bits
+        // mark the sampled rules, which are listed in order, and the samples
+        // of the k-th one are samples[sampleStarts[k]..sampleStarts[k + 1])
+        uint64_t sampleLength = UINT64_MAX;
+        std::vector<uint64_t> sampledBits;
+        std::vector<Symbol> sampledRules;
+        std::vector<uint64_t> sampleStarts;
+        std::vector<uint64_t> samples;
+
+        // the character of a rule to start scanning for the position ignore
+        // in its expansion at, which is 0 unless the rule is sampled; ignore
+        // is reduced by the expansions of the characters before it
+        Offset skipSamples(Symbol rule, uint64_t& ignore) const;
+
+        // get for grammars whose rules are pairs; descends by comparing the
+        // expansion size of left characters only and decodes without reading
+        // the rules' dummy codes
+        void getPairs(Context& context, char* out, uint64_t begin, uint64_t end) const requires CFG_T::PAIR_RULES;
+
+        // these are called by concurrent queries, so they can't modify the index
+        virtual void rankSelect(uint64_t i, Offset& rank, uint64_t& select) const = 0;
+        virtual uint64_t expansionSize(Symbol rule) const = 0;
 
     protected:
 
@@ -24,7 +132,165 @@ class RandomAccess
 
     public:
 
-        RandomAccess(CFG_T* cfg): cfg(cfg), ruleStack(), indexStack() { };
+        /**
+         * A position in the original string that's read sequentially. The
+         * cursor keeps its descent between reads, so a read continues where
+         * the last one ended instead of descending from the start rule again,
+         * and seeking forward only goes back up as far as the rules both
+         * positions are in. A cursor is only used by one thread at a time.
+         **/
+        class Cursor
+        {
+            private:
+
+                const RandomAccess* index;
+
+                // the context is the caller's or the cursor's own
+                std::unique_ptr<Context> ownContext;
+                Context* context;
+
+                // the descent as in get, or getPairs where c is the character
+                // that expands to the text at position and the pending
+                // characters on the rule stack follow it. The current rule's
+                // expansion starts at ruleBegin and position is the position
+                // of the next character to read
+                Symbol r, c;
+                Symbol level = 0;
+                Offset i, blockIndex, blockSize;
+                uint64_t ruleBegin, position;
+
+                // how much of the current character's expansion was read if
+                // it's cached and only part of it was read
+                uint64_t skip = 0;
+
+                void seekRules(uint64_t begin);
+                void seekPairs(uint64_t begin) requires CFG_T::PAIR_RULES;
+                void nextRules(char* out, uint64_t length);
+                void nextPairs(char* out, uint64_t length) requires CFG_T::PAIR_RULES;
+
+            public:
+
+                /**
+                 * An input iterator over the characters from the cursor's
+                 * position to the end of the string, which reads from the
+                 * cursor as it's incremented.
+                 **/
+                class Iterator
+                {
+                    private:
+
+                        Cursor* cursor;
+                        uint64_t position;
+                        char character = 0;
+
+                    public:
+
+                        typedef std::input_iterator_tag iterator_category;
+                        typedef char value_type;
+                        typedef std::ptrdiff_t difference_type;
+                        typedef const char* pointer;
+                        typedef const char& reference;
+
+                        Iterator(): cursor(nullptr), position(0) { }
+
+                        Iterator(Cursor* cursor, uint64_t position): cursor(cursor), position(position)
+                        {
+                            if (cursor != nullptr) cursor->next(&character, 1);
+                        }
+
+                        const char& operator*() const { return character; }
+
+                        Iterator& operator++()
+                        {
+                            position++;
+                            cursor->next(&character, 1);
+                            return *this;
+                        }
+
+                        void operator++(int) { ++*this; }
+
+                        bool operator==(const Iterator& other) const { return position == other.position; }
+                };
+
+                /**
+                 * @param index The index to read the original string with.
+                 * @param position The position to start reading at.
+                 */
+                Cursor(const RandomAccess& index, uint64_t position = 0);
+
+                /**
+                 * @param index The index to read the original string with.
+                 * @param context The context of the calling thread, which is used by the cursor until it's destroyed.
+                 * @param position The position to start reading at.
+                 */
+                Cursor(const RandomAccess& index, Context& context, uint64_t position = 0);
+
+                /**
+                 * Moves the cursor to a position; seeking to the end of the
+                 * string is allowed.
+                 *
+                 * @param position The position of the next character to read.
+                 */
+                void seek(uint64_t position);
+
+                /**
+                 * Reads the next characters and moves the cursor past them.
+                 *
+                 * @param out The buffer to write the characters to.
+                 * @param n The number of characters to read.
+                 * @return The number of characters read, which is less than n at the end of the string.
+                 */
+                uint64_t next(char* out, uint64_t n);
+
+                uint64_t getPosition() const { return position; }
+
+                Iterator begin() { return Iterator(this, position); }
+                Iterator end() { return Iterator(nullptr, index->cfg->getTextLength()); }
+        };
+
+    public:
+
+        RandomAccess(CFG_T* cfg): context(cfg), cacheEnd(CFG_T::ALPHABET_SIZE), cfg(cfg) { };
+
+        virtual ~RandomAccess() { }
+
+        // the memory of the index, including the cached expansions and the samples
+        virtual uint64_t memSize() const = 0;
+
+        /**
+          * Stores the expansions of the rules whose expansions are at most
+          * maxLength characters, so that queries copy them instead of
+          * descending into them. Rules are in smallest-expansion-first
+          * order, so these are the rules before the first longer one. The
+          * rules are cached in order until their expansions and offsets no
+          * longer fit in maxBytes.
+          *
+          * @param maxLength The length of the longest expansion to cache.
+          * @param maxBytes The most memory the cache can use.
+          */
+        void cacheExpansions(uint64_t maxLength, uint64_t maxBytes = UINT64_MAX);
+
+        uint64_t getNumCachedRules() const { return cacheEnd - CFG_T::ALPHABET_SIZE; }
+        uint64_t cacheMemSize() const { return cache.size() + sizeof(uint64_t) * cacheOffsets.size(); }
+
+        /**
+          * Samples the expansion offsets of every BLOCK_SIZE-th character
+          * of the rules with more than minLength characters, so that queries
+          * jump close to the character they descend into instead of adding
+          * up the expansion sizes of the characters before it. A lower
+          * minLength samples more rules, which uses more memory and saves
+          * more time on rules of middling length.
+          *
+          * @param minLength The length of the longest rule that isn't sampled, which is at least BLOCK_SIZE.
+          */
+        void sampleRules(uint64_t minLength);
+
+        uint64_t getSampleLength() const { return sampleLength; }
+        uint64_t getNumSampledRules() const { return sampledRules.size(); }
+        uint64_t sampleMemSize() const
+        {
+            return sizeof(uint64_t) * (sampledBits.size() + sampleStarts.size() + samples.size()) + sizeof(Symbol) * sampledRules.size();
+        }
 
         /**
           * Gets a substring in the original string.
@@ -34,8 +300,61 @@ class RandomAccess
           * @param end The end position of the substring in the original string.
           * @throws Exception if begin or end is out of bounds.
           */
-        //void get(std::ostream& out, uint64_t begin, uint64_t end);
-        void get(char* out, uint64_t begin, uint64_t end);
+        void get(char* out, uint64_t begin, uint64_t end) { get(context, out, begin, end); }
+
+        /**
+          * Gets a substring in the original string using the given context,
+          * which lets threads query the index at once.
+          *
+          * @param context The context of the calling thread.
+          * @param out The output stream to write the substring to.
+          * @param begin The start position of the substring in the original string.
+          * @param end The end position of the substring in the original string.
+          * @throws Exception if begin or end is out of bounds.
+          */
+        void get(Context& context, char* out, uint64_t begin, uint64_t end) const;
+
+        /**
+          * Gets many substrings in the original string at once. The ranges
+          * are decoded in order of position so that every range continues
+          * the descent of the one before it, only going back up as far as the
+          * rules they share, instead of descending from the start rule again.
+          *
+          * @param context The context of the calling thread.
+          * @param numRanges The number of substrings.
+          * @param begins The start positions of the substrings in the original string.
+          * @param ends The end positions of the substrings in the original string.
+          * @param out The buffer to write the substrings to, back to back in the order of the ranges.
+          * @throws Exception if a begin or end is out of bounds.
+          */
+        void getBatch(Context& context, uint64_t numRanges, const uint64_t* begins, const uint64_t* ends, char* out) const;
+        void getBatch(uint64_t numRanges, const uint64_t* begins, const uint64_t* ends, char* out) { getBatch(context, numRanges, begins, ends, out); }
+
+        /**
+          * Gets a substring in the original string with several threads,
+          * each decoding its own slice of the substring with its own cursor.
+          *
+          * @param out The buffer to write the substring to.
+          * @param begin The start position of the substring in the original string.
+          * @param end The end position of the substring in the original string.
+          * @param threads The number of threads to decode with.
+          * @throws Exception if begin or end is out of bounds.
+          */
+        void getParallel(char* out, uint64_t begin, uint64_t end, uint64_t threads) const;
+
+        /**
+          * Writes a substring in the original string, e.g. the whole string,
+          * to a stream. The substring is decoded a window at a time with
+          * getParallel's split, and every window is written while the next
+          * one is decoded, so only two windows are in memory at once.
+          *
+          * @param out The stream to write the substring to.
+          * @param begin The start position of the substring in the original string.
+          * @param end The end position of the substring in the original string.
+          * @param threads The number of threads to decode with.
+          * @throws Exception if begin or end is out of bounds.
+          */
+        void extract(std::ostream& out, uint64_t begin, uint64_t end, uint64_t threads) const;
 };
 
 }
@@ -2,19 +2,39 @@
 #define INCLUDED_FRAS_CFG_RANDOM_ACCESS_BV
 
 #include "fras/cfg/random_access.hpp"
+#include "fras/array/jagged_array_bp_header.hpp"
+#include "fras/array/jagged_array_bp_index.hpp"
+#include "fras/array/jagged_array_bp_mono.hpp"
+#include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
+#include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/rank_support.hpp>
+#include <sdsl/select_support.hpp>
+#include <sdsl/util.hpp>
 
 namespace fras {
 
 /**
- * Indexes a CFG for random access using a bit vector.
+ * Indexes a CFG for random access using plain bit vectors, which take a bit
+ * for every position of the text but answer rank and select faster than the
+ * sparse bit vectors of RandomAccessSD.
  * NOTE: this class requires that the CFG rules are in smallest-expansion-first order.
  **/
-template <class CFG_T, class sdsl_bv, class sdsl_rank, class sdsl_select>
-class RandomAccessBV : public RandomAccess
+template <class CFG_T, class sdsl_bv = sdsl::bit_vector, class sdsl_rank = sdsl::rank_support_v5<>, class sdsl_select = sdsl::select_support_mcl<>>
+class RandomAccessBV : public RandomAccess<CFG_T>
 {
 
 private:
 
+    typedef typename CFG_T::Symbol Symbol;
+    typedef typename CFG_T::Offset Offset;
+
     sdsl_bv startBitvector;
     sdsl_rank startBitvectorRank;
     sdsl_select startBitvectorSelect;
@@ -22,104 +42,124 @@ private:
     sdsl_bv expansionBitvector;
     sdsl_rank expansionBitvectorRank;
 
-    uint64_t* expansionSizes;
+    std::vector<uint64_t> expansionSizes;
 
-    void setBits()
+    void initializeBitvectors()
     {
-        // prepare to compute rule sizes
-        uint64_t* ruleSizes = new uint64_t[cfg->startRule];
-        for (int i = 0; i < CFG_T::ALPHABET_SIZE; i++) {
-            ruleSizes[i] = 1;
-        }
-        for (int i = CFG_T::ALPHABET_SIZE; i < cfg->startRule; i++) {
-            ruleSizes[i] = 0;
-        }
+        startBitvector = sdsl_bv(this->cfg->getTextLength(), 0);
+        // startRule = numRules + CFG::ALPHABET_SIZE
+        expansionBitvector = sdsl_bv(this->cfg->getStartRule(), 0);
+
+        // the CFG hands over the rule sizes it computed when it was loaded
+        typename CFG_T::ExpansionSizes ruleSizes = this->cfg->takeExpansionSizes();
 
         // set the start bitvector
         uint64_t pos = 0;
-        int c;
-        for (int i = 0; i < cfg->startSize; i++) {
-            c = cfg->get(cfg->startRule, i);
+        Symbol c;
+        for (Offset i = 0; i < this->cfg->getStartSize(); i++) {
+            c = this->cfg->get(this->cfg->getStartRule(), i);
             startBitvector[pos] = 1;
-            pos += ruleSize(ruleSizes, c);
+            pos += ruleSizes.get(c);
         }
 
-        // set the expansion bitvector and count the number of unique expansions
-        uint64_t previousSize = 1;
-        int numExpansions = 1;  // 1 will be in the array but not have a bit set
-        for (int i = 0; i < cfg->startRule; i++) {
-            if (ruleSizes[i] > previousSize) {
-                numExpansions++;
-                previousSize = ruleSizes[i];
-                expansionBitvector[i] = 1;
-            }
+        // set the expansion bitvector; the sizes are already grouped by
+        // unique expansion and the first, 1, will be in the array but not
+        // have a bit set
+        uint64_t numExpansions = 1;
+        for (; numExpansions < ruleSizes.firstRules.size(); numExpansions++) {
+            Symbol i = ruleSizes.firstRules[numExpansions];
+            if (i >= this->cfg->getStartRule()) break;
+            expansionBitvector[i] = 1;
         }
-
-        // initialize the expansion array
-        expansionSizes = new uint64_t[numExpansions];
-        previousSize = 1;
-        numExpansions = 0;
-        expansionSizes[numExpansions++] = previousSize;
-        for (int i = 0; i < cfg->startRule; i++) {
-            if (ruleSizes[i] > previousSize) {
-                previousSize = ruleSizes[i];
-                expansionSizes[numExpansions++] = previousSize;
-            }
-        }
-
-        // clean up
-        delete[] ruleSizes;
+        expansionSizes.assign(ruleSizes.sizes.begin(), ruleSizes.sizes.begin() + numExpansions);
     }
 
-    uint64_t ruleSize(uint64_t* ruleSizes, int rule)
-    {
-        if (ruleSizes[rule] != 0) return ruleSizes[rule];
-
-        int c;
-        for (int i = 0; (c = cfg->get(rule, i)) != CFG_T::DUMMY_CODE; i++) {
-            if (ruleSizes[c] == 0) {
-                ruleSize(ruleSizes, c);
-            }
-            ruleSizes[rule] += ruleSizes[c];
-        }
-
-        return ruleSizes[rule];
-    }
-
-    void rankSelect(uint64_t i, int& rank, uint64_t& select)
+    void rankSelect(uint64_t i, Offset& rank, uint64_t& select) const
     {
         // i+1 because rank is exclusive [0, i) and we want inclusive [0, i]
         rank = startBitvectorRank.rank(i + 1);
         select = startBitvectorSelect.select(rank);
     }
 
-    uint64_t expansionSize(int rule)
+    uint64_t expansionSize(Symbol rule) const
     {
         // i+1 because rank is exclusive [0, i) and we want inclusive [0, i]
-        int rank = expansionBitvectorRank.rank(rule + 1);
+        uint64_t rank = expansionBitvectorRank.rank(rule + 1);
         return expansionSizes[rank];
     }
 
 public:
 
-    RandomAccessBV(CFG_T* cfg): RandomAccess(cfg)
+    uint64_t memSize() const
     {
-        startBitvector = sdsl_bv(cfg->textLength, 0);
-        // startRule = numRules + CFG::ALPHABET_SIZE
-        expansionBitvector = sdsl_bv(cfg->startRule, 0);
-        setBits();
+        uint64_t startBitvectorSize = sdsl::size_in_bytes(startBitvector) +
+                                      sdsl::size_in_bytes(startBitvectorRank) +
+                                      sdsl::size_in_bytes(startBitvectorSelect);
+        uint64_t expansionBitvectorSize = sdsl::size_in_bytes(expansionBitvector) +
+                                          sdsl::size_in_bytes(expansionBitvectorRank);
+        uint64_t expansionSize = sizeof(uint64_t) * expansionSizes.size();
+        return startBitvectorSize + expansionBitvectorSize + expansionSize +
+               this->cacheMemSize() + this->sampleMemSize();
+    }
+
+    RandomAccessBV(CFG_T* cfg): RandomAccess<CFG_T>(cfg)
+    {
+        initializeBitvectors();
         startBitvectorRank = sdsl_rank(&startBitvector);
         startBitvectorSelect = sdsl_select(&startBitvector);
         expansionBitvectorRank = sdsl_rank(&expansionBitvector);
     }
 
-    ~RandomAccessBV()
-    {
-        delete[] expansionSizes;
-    };
+    // the supports point to the bit vectors
+    RandomAccessBV(const RandomAccessBV&) = delete;
+    RandomAccessBV& operator=(const RandomAccessBV&) = delete;
 
 };
 
+// instantiate the class
+template class RandomAccessBV<CFG<JaggedArrayBpHeader<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<>>>;
+template class RandomAccessBV<CFG<JaggedArrayInt<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>>;
+template class RandomAccessBV<CFG<JaggedArrayIntFlat<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpWord>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>>;
+template class RandomAccessBV<CFG<JaggedArrayIntEF<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpEF>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>>;
+template class RandomAccessBV<CFG<JaggedArrayDac<>>>;
+template class RandomAccessBV<CFG<JaggedArrayPair<>>>;
+template class RandomAccessBV<CFG<JaggedArrayPairBp<>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpHeader<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayInt<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayIntFlat<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayIntEF<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayDac<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayPair<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayPairBp<uint64_t>>>;
+template class RandomAccessBV<CFG<JaggedArrayVirtual<JaggedArrayInt<>>>>;
+template class RandomAccessBV<CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>>;
+template class RandomAccessBV<CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>>;
+template class RandomAccessBV<CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>>;
+
 }
 
 #endif
@@ -0,0 +1,152 @@
+#ifndef INCLUDED_FRAS_CFG_RANDOM_ACCESS_PLAIN
+#define INCLUDED_FRAS_CFG_RANDOM_ACCESS_PLAIN
+
+#include "fras/cfg/random_access.hpp"
+#include "fras/array/jagged_array_bp_header.hpp"
+#include "fras/array/jagged_array_bp_index.hpp"
+#include "fras/array/jagged_array_bp_mono.hpp"
+#include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
+#include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace fras {
+
+/**
+ * Indexes a CFG for random access using plain arrays: the expansion size of
+ * every character is read from an array instead of being ranked in a bit
+ * vector, and the text position of every START_SAMPLE_RATE-th character of
+ * the start rule is sampled, so a position is found by binary searching the
+ * samples and adding up the sizes of at most START_SAMPLE_RATE characters.
+ * This uses 8 bytes for every rule, but no rank or select is done during a
+ * query.
+ * NOTE: this class requires that the CFG rules are in smallest-expansion-first order.
+ **/
+template <class CFG_T>
+class RandomAccessPlain : public RandomAccess<CFG_T>
+{
+
+private:
+
+    typedef typename CFG_T::Symbol Symbol;
+    typedef typename CFG_T::Offset Offset;
+
+    static const Offset START_SAMPLE_RATE = 16;
+
+    // indexed by character, including the terminal characters
+    std::vector<uint64_t> expansionSizes;
+    // the text position of start rule character START_SAMPLE_RATE * i
+    std::vector<uint64_t> startSamples;
+
+    void initializeArrays()
+    {
+        // the CFG hands over the rule sizes it computed when it was loaded;
+        // they're grouped by unique expansion and rules are in order
+        typename CFG_T::ExpansionSizes ruleSizes = this->cfg->takeExpansionSizes();
+        Symbol startRule = this->cfg->getStartRule();
+        expansionSizes.resize(startRule);
+        uint64_t k = 0;
+        for (Symbol c = 0; c < startRule; c++) {
+            while (k + 1 < ruleSizes.firstRules.size() && ruleSizes.firstRules[k + 1] <= c) k++;
+            expansionSizes[c] = ruleSizes.sizes[k];
+        }
+
+        uint64_t pos = 0;
+        startSamples.reserve((this->cfg->getStartSize() + START_SAMPLE_RATE - 1) / START_SAMPLE_RATE);
+        for (Offset i = 0; i < this->cfg->getStartSize(); i++) {
+            if (i % START_SAMPLE_RATE == 0) startSamples.push_back(pos);
+            pos += expansionSizes[this->cfg->get(startRule, i)];
+        }
+    }
+
+    void rankSelect(uint64_t i, Offset& rank, uint64_t& select) const
+    {
+        // the last sampled character that starts at or before i, and then
+        // the character after it that i is in
+        uint64_t k = std::upper_bound(startSamples.begin(), startSamples.end(), i) - startSamples.begin() - 1;
+        Symbol characters[START_SAMPLE_RATE];
+        Offset j = k * START_SAMPLE_RATE;
+        this->cfg->get(this->cfg->getStartRule(), j, START_SAMPLE_RATE, characters);
+        uint64_t pos = startSamples[k];
+        Offset l = 0;
+        while (pos + expansionSizes[characters[l]] <= i) {
+            pos += expansionSizes[characters[l++]];
+        }
+        // rank counts the characters that start at or before i
+        rank = j + l + 1;
+        select = pos;
+    }
+
+    uint64_t expansionSize(Symbol rule) const
+    {
+        return expansionSizes[rule];
+    }
+
+public:
+
+    uint64_t memSize() const
+    {
+        return sizeof(uint64_t) * (expansionSizes.size() + startSamples.size()) +
+               this->cacheMemSize() + this->sampleMemSize();
+    }
+
+    RandomAccessPlain(CFG_T* cfg): RandomAccess<CFG_T>(cfg)
+    {
+        initializeArrays();
+    }
+
+};
+
+// instantiate the class
+template class RandomAccessPlain<CFG<JaggedArrayBpHeader<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayInt<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>>;
+template class RandomAccessPlain<CFG<JaggedArrayIntFlat<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpWord>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>>;
+template class RandomAccessPlain<CFG<JaggedArrayIntEF<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpEF>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>>;
+template class RandomAccessPlain<CFG<JaggedArrayDac<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayPair<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayPairBp<>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpHeader<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayInt<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayIntFlat<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayIntEF<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayDac<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayPair<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayPairBp<uint64_t>>>;
+template class RandomAccessPlain<CFG<JaggedArrayVirtual<JaggedArrayInt<>>>>;
+template class RandomAccessPlain<CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>>;
+template class RandomAccessPlain<CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>>;
+template class RandomAccessPlain<CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>>;
+
+}
+
+#endif
@@ -2,9 +2,19 @@
 #define INCLUDED_FRAS_CFG_RANDOM_ACCESS_SD
 
 #include "fras/cfg/random_access.hpp"
+#include "fras/array/jagged_array_bp_header.hpp"
 #include "fras/array/jagged_array_bp_index.hpp"
 #include "fras/array/jagged_array_bp_mono.hpp"
+#include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
 #include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include "fras/array/mapped_file.hpp"
+#include <ostream>
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/util.hpp>
 
@@ -20,6 +30,9 @@ class RandomAccessSD : public RandomAccess<CFG_T>
 
 private:
 
+    typedef typename CFG_T::Symbol Symbol;
+    typedef typename CFG_T::Offset Offset;
+
     sdsl::sd_vector<> startBitvector;
     sdsl::sd_vector<>::rank_1_type startBitvectorRank;
     sdsl::sd_vector<>::select_1_type startBitvectorSelect;
@@ -27,7 +40,10 @@ private:
     sdsl::sd_vector<> expansionBitvector;
     sdsl::sd_vector<>::rank_1_type expansionBitvectorRank;
 
-    uint64_t* expansionSizes;
+    const uint64_t* expansionSizes;
+
+    // whether the expansion sizes point into a MappedFile
+    bool mapped = false;
 
     void initializeBitvectors()
     {
@@ -35,85 +51,55 @@ private:
         // startRule = numRules + CFG::ALPHABET_SIZE
         sdsl::bit_vector tmpExpansionBitvector(this->cfg->getStartRule(), 0);
 
-        // prepare to compute rule sizes
-        uint64_t* ruleSizes = new uint64_t[this->cfg->getStartRule()];
-        for (int i = 0; i < CFG_T::ALPHABET_SIZE; i++) {
-            ruleSizes[i] = 1;
-        }
-        for (int i = CFG_T::ALPHABET_SIZE; i < this->cfg->getStartRule(); i++) {
-            ruleSizes[i] = 0;
-        }
+        // the CFG hands over the rule sizes it computed when it was loaded
+        typename CFG_T::ExpansionSizes ruleSizes = this->cfg->takeExpansionSizes();
 
         // set the start bitvector
         uint64_t pos = 0;
-        int c;
-        for (int i = 0; i < this->cfg->getStartSize(); i++) {
+        Symbol c;
+        for (Offset i = 0; i < this->cfg->getStartSize(); i++) {
             c = this->cfg->get(this->cfg->getStartRule(), i);
             tmpStartBitvector[pos] = 1;
-            pos += ruleSize(ruleSizes, c);
+            pos += ruleSizes.get(c);
         }
         startBitvector = sdsl::sd_vector<>(tmpStartBitvector);
 
-        // set the expansion bitvector and count the number of unique expansions
-        uint64_t previousSize = 1;
-        int numExpansions = 1;  // 1 will be in the array but not have a bit set
-        for (int i = 0; i < this->cfg->getStartRule(); i++) {
-            if (ruleSizes[i] > previousSize) {
-                numExpansions++;
-                previousSize = ruleSizes[i];
-                tmpExpansionBitvector[i] = 1;
-            }
+        // set the expansion bitvector and count the number of unique
+        // expansions; the sizes are already grouped by unique expansion and the
+        // first, 1, will be in the array but not have a bit set
+        uint64_t numExpansions = 1;
+        for (; numExpansions < ruleSizes.firstRules.size(); numExpansions++) {
+            Symbol i = ruleSizes.firstRules[numExpansions];
+            if (i >= this->cfg->getStartRule()) break;
+            tmpExpansionBitvector[i] = 1;
         }
         expansionBitvector = sdsl::sd_vector<>(tmpExpansionBitvector);
 
         // initialize the expansion array
-        expansionSizes = new uint64_t[numExpansions];
-        previousSize = 1;
-        numExpansions = 0;
-        expansionSizes[numExpansions++] = previousSize;
-        for (int i = 0; i < this->cfg->getStartRule(); i++) {
-            if (ruleSizes[i] > previousSize) {
-                previousSize = ruleSizes[i];
-                expansionSizes[numExpansions++] = previousSize;
-            }
-        }
-
-        // clean up
-        delete[] ruleSizes;
-    }
-
-    uint64_t ruleSize(uint64_t* ruleSizes, int rule)
-    {
-        if (ruleSizes[rule] != 0) return ruleSizes[rule];
-
-        int c;
-        for (int i = 0; (c = this->cfg->get(rule, i)) != CFG_T::DUMMY_CODE; i++) {
-            if (ruleSizes[c] == 0) {
-                ruleSize(ruleSizes, c);
-            }
-            ruleSizes[rule] += ruleSizes[c];
+        uint64_t* sizes = new uint64_t[numExpansions];
+        for (uint64_t i = 0; i < numExpansions; i++) {
+            sizes[i] = ruleSizes.sizes[i];
         }
-
-        return ruleSizes[rule];
+        expansionSizes = sizes;
     }
 
-    void rankSelect(uint64_t i, int& rank, uint64_t& select)
+    void rankSelect(uint64_t i, Offset& rank, uint64_t& select) const
     {
         // i+1 because rank is exclusive [0, i) and we want inclusive [0, i]
         rank = startBitvectorRank.rank(i + 1);
         select = startBitvectorSelect.select(rank);
     }
 
-    uint64_t expansionSize(int rule)
+    uint64_t expansionSize(Symbol rule) const
     {
         // i+1 because rank is exclusive [0, i) and we want inclusive [0, i]
-        int rank = expansionBitvectorRank.rank(rule + 1);
+        uint64_t rank = expansionBitvectorRank.rank(rule + 1);
         return expansionSizes[rank];
     }
 
 public:
 
-    uint64_t memSize()
+    uint64_t memSize() const
     {
         //uint64_t numExpansions = sdsl::util::cnt_one_bits(expansionBitvector);
         //uint64_t expansionSize = sizeof(uint64_t) * numExpansions;
@@ -128,9 +114,9 @@ public:
         uint64_t expansionBitvectorSize = sdsl::size_in_bytes(expansionBitvector);
         uint64_t expansionBitvectorRankSize = sdsl::size_in_bytes(expansionBitvectorRank);
 
-        return startBitvectorSelectSize + startBitvectorRankSize + startBitvectorSelectSize +
+        return startBitvectorSize + startBitvectorRankSize + startBitvectorSelectSize +
                expansionBitvectorSize + expansionBitvectorRankSize +
-               expansionSize;
+               expansionSize + this->cacheMemSize() + this->sampleMemSize();
     }
 
     RandomAccessSD(CFG_T* cfg): RandomAccess<CFG_T>(cfg)
@@ -141,17 +127,92 @@ public:
         expansionBitvectorRank = sdsl::sd_vector<>::rank_1_type(&expansionBitvector);
     }
 
+    /**
+     * Loads an index that was written with serialize, e.g. after its CFG in
+     * the same file. The expansion sizes are used in place and the sparse
+     * bit vectors are copied out of the file.
+     *
+     * @param cfg The CFG the index was built for.
+     * @param file The mapped file, positioned at the start of the index.
+     */
+    RandomAccessSD(CFG_T* cfg, MappedFile& file): RandomAccess<CFG_T>(cfg), mapped(true)
+    {
+        file.readStructure(startBitvector);
+        file.readStructure(expansionBitvector);
+        startBitvectorRank = sdsl::sd_vector<>::rank_1_type(&startBitvector);
+        startBitvectorSelect = sdsl::sd_vector<>::select_1_type(&startBitvector);
+        expansionBitvectorRank = sdsl::sd_vector<>::rank_1_type(&expansionBitvector);
+        uint64_t numExpansions = file.readValue<uint64_t>();
+        expansionSizes = file.readArray<uint64_t>(numExpansions);
+    }
+
     ~RandomAccessSD()
     {
-        delete[] expansionSizes;
+        if (!mapped) {
+            delete[] expansionSizes;
+        }
     };
 
+    /**
+     * Writes the index so that it can be loaded with the MappedFile constructor.
+     *
+     * @param out The binary stream to write the index to.
+     */
+    void serialize(std::ostream& out)
+    {
+        writeStructure(out, startBitvector);
+        writeStructure(out, expansionBitvector);
+        // +1 for the size 1, which is in the array but doesn't have a bit set
+        uint64_t numExpansions = expansionBitvectorRank.rank(expansionBitvector.size()) + 1;
+        writeValue(out, numExpansions);
+        writeArray(out, expansionSizes, numExpansions);
+    }
+
 };
 
 // instantiate the class
-template class RandomAccessSD<CFG<JaggedArrayBpIndex>>;
-template class RandomAccessSD<CFG<JaggedArrayBpMono>>;
-template class RandomAccessSD<CFG<JaggedArrayInt>>;
+template class RandomAccessSD<CFG<JaggedArrayBpHeader<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<>>>;
+template class RandomAccessSD<CFG<JaggedArrayInt<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>>;
+template class RandomAccessSD<CFG<JaggedArrayIntFlat<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpWord>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>>;
+template class RandomAccessSD<CFG<JaggedArrayIntEF<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpEF>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>>;
+template class RandomAccessSD<CFG<JaggedArrayDac<>>>;
+template class RandomAccessSD<CFG<JaggedArrayPair<>>>;
+template class RandomAccessSD<CFG<JaggedArrayPairBp<>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpHeader<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayInt<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayIntFlat<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayIntEF<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayDac<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayPair<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayPairBp<uint64_t>>>;
+template class RandomAccessSD<CFG<JaggedArrayVirtual<JaggedArrayInt<>>>>;
+template class RandomAccessSD<CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>>;
+template class RandomAccessSD<CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>>;
+template class RandomAccessSD<CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>>;
 
 }
 
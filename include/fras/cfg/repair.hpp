@@ -0,0 +1,178 @@
+#ifndef INCLUDED_FRAS_CFG_REPAIR
+#define INCLUDED_FRAS_CFG_REPAIR
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fras {
+
+/**
+ * Builds a RePair grammar, i.e. an SLP whose rules are all pairs except the
+ * start rule, from a text. RePair replaces the most frequent pair one at a
+ * time; this builder replaces pairs in rounds instead so that every round can
+ * replace pairs in parallel. A round replaces the pairs that are at least half
+ * as frequent as the most frequent pair, most frequent first, skipping pairs
+ * that could overlap one that's already chosen: no character is the left
+ * character of one chosen pair and the right character of another, and a pair
+ * of the same character is only chosen if the character isn't in any other
+ * chosen pair. Runs are paired from their start. Like RePair, the pairs are
+ * only counted once; every round updates the counts of the pairs its
+ * replacements remove and add. Characters are the text's bytes and rules are
+ * numbered from ALPHABET_SIZE in the order they're created.
+ **/
+template <class Symbol_T>
+class RePair
+{
+
+public:
+
+    typedef Symbol_T Symbol;
+
+    static const Symbol ALPHABET_SIZE = 256;
+
+private:
+
+    typedef std::pair<Symbol, Symbol> Pair;
+
+    // mixes both characters so that pairs can be split between shards by their hash
+    struct PairHash
+    {
+        std::size_t operator()(const Pair& pair) const
+        {
+            uint64_t hash = (uint64_t) pair.first * 0x9e3779b97f4a7c15 ^ (uint64_t) pair.second * 0xc2b2ae3d27d4eb4f;
+            return hash ^ (hash >> 29);
+        }
+    };
+
+    typedef std::pair<Pair, uint64_t> PairCount;
+
+    // an open addressing hash table of pair counts with linear probing, which
+    // is much faster to update and to scan than a node-based map. Counts wrap
+    // around, so adding a negative delta subtracts it. Pairs whose count drops
+    // to 0 keep their slot until the table grows
+    class PairCounts
+    {
+    private:
+
+        static constexpr Symbol EMPTY = std::numeric_limits<Symbol>::max();
+
+        // the number of slots is a power of two
+        std::vector<PairCount> slots;
+        uint64_t used = 0;
+        int bits = 0;
+
+        uint64_t slot(const Pair& pair) const
+        {
+            return (PairHash()(pair) * 0x9e3779b97f4a7c15) >> (64 - bits);
+        }
+
+        void grow()
+        {
+            std::vector<PairCount> old = std::move(slots);
+            uint64_t live = 0;
+            for (auto& [pair, count] : old) {
+                if (pair.first != EMPTY && count != 0) live++;
+            }
+            for (bits = 4; ((uint64_t) 1 << bits) < 4 * live; bits++) { }
+            slots.assign((uint64_t) 1 << bits, PairCount(Pair(EMPTY, EMPTY), 0));
+            used = 0;
+            for (auto& [pair, count] : old) {
+                if (pair.first != EMPTY && count != 0) (*this)[pair] = count;
+            }
+        }
+
+    public:
+
+        // the count of a pair, which is added with a count of 0 if it isn't in the table
+        uint64_t& operator[](const Pair& pair)
+        {
+            if (2 * (used + 1) > slots.size()) grow();
+            uint64_t mask = slots.size() - 1;
+            for (uint64_t i = slot(pair); ; i = (i + 1) & mask) {
+                if (slots[i].first == pair) return slots[i].second;
+                if (slots[i].first.first == EMPTY) {
+                    used++;
+                    slots[i] = PairCount(pair, 0);
+                    return slots[i].second;
+                }
+            }
+        }
+
+        // calls visit(pair, count) with every pair whose count isn't 0
+        template <class Visit>
+        void forEach(Visit visit) const
+        {
+            for (auto& [pair, count] : slots) {
+                if (pair.first != EMPTY && count != 0) visit(pair, count);
+            }
+        }
+
+        uint64_t size() const { return used; }
+    };
+
+    // the roles of characters in the pairs chosen in a round
+    static const uint8_t LEFT = 1;
+    static const uint8_t RIGHT = 2;
+    static const uint8_t RUN = LEFT | RIGHT;
+
+    // rule ALPHABET_SIZE + i is the pair rules[2 * i], rules[2 * i + 1]
+    std::vector<Symbol> rules;
+    std::vector<Symbol> sequence;
+    uint64_t numRounds = 0;
+
+    // how many times every pair occurs in the sequence, including
+    // overlapping occurrences in runs, split into shards by hash so that
+    // threads can update different shards at once
+    std::vector<PairCounts> counts;
+
+    // the pairs chosen in the current round, the rules that replace them, and
+    // the role of every character in them
+    std::unordered_map<Pair, Symbol, PairHash> chosen;
+    std::vector<uint8_t> roles;
+
+    uint64_t shard(const Pair& pair) const { return PairHash()(pair) % counts.size(); }
+
+    // counts the pairs of the text
+    void countPairs(uint64_t threads);
+    // chooses the pairs to replace; returns false if no pair occurs twice
+    bool choosePairs(uint64_t threads);
+    // whether position i of the sequence starts a chosen pair that's
+    // replaced; runs are scanned back to their start
+    bool startsPair(uint64_t i) const;
+    // replaces the chosen pairs in the sequence and updates the counts
+    void replacePairs(uint64_t threads);
+
+public:
+
+    /**
+     * Reads a text to build the grammar of. The text isn't used once it's
+     * read, so it can be freed before the grammar is built.
+     *
+     * @param text The text, which can't have 0 bytes since 0 is the dummy code that ends CFG rules.
+     * @param length The length of the text.
+     * @throws Exception if the text has a 0 byte.
+     */
+    RePair(const char* text, uint64_t length);
+
+    /**
+     * Builds the grammar by replacing pairs until no pair occurs twice.
+     *
+     * @throws Exception if the text has too many rules for the Symbol type.
+     */
+    void build();
+
+    uint64_t getNumRules() const { return rules.size() / 2; }
+    uint64_t getNumRounds() const { return numRounds; }
+
+    // the rules' pairs back to back, followed by the start rule, i.e. the
+    // sequence the text was reduced to; the builder is left empty
+    std::vector<Symbol> takeCharacters();
+
+};
+
+}
+
+#endif
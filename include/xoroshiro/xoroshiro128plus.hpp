@@ -28,6 +28,9 @@ public:
   result_type operator()();
   void seed(std::function<uint32_t(void)>);
   void seed(const std::array<uint32_t, 4> &);
+  // advances the state as much as 2^64 calls, so engines jumped a different
+  // number of times from the same seed give non-overlapping streams
+  void jump();
 };
 
 }
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstring>
+#include "fras/array/jagged_array_bp_header.hpp"
+#include "fras/array/jagged_array_bp_index.hpp"
+#include "fras/array/jagged_array_bp_mono.hpp"
+#include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
+#include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include "fras/cfg/cfg.hpp"
+#include "fras/cfg/block_cache.hpp"
+
+namespace fras {
+
+// private
+
+template <class CFG_T>
+uint8_t BlockCache<CFG_T>::frequency(const Shard& shard, uint64_t block) const
+{
+    uint64_t n = shard.frequencies.size();
+    return std::min(shard.frequencies[block % n], shard.frequencies[(block * 0xbf58476d1ce4e5b9 >> 17) % n]);
+}
+
+template <class CFG_T>
+uint8_t BlockCache<CFG_T>::countQuery(Shard& shard, uint64_t block)
+{
+    if (++shard.queries == AGING_PERIOD * slotsPerShard) {
+        for (uint8_t& count : shard.frequencies) count /= 2;
+        shard.queries = 0;
+    }
+
+    // only the smaller counter is incremented, so that a counter that's
+    // shared with hotter blocks doesn't grow further on this block's account
+    uint64_t n = shard.frequencies.size();
+    uint8_t& first = shard.frequencies[block % n];
+    uint8_t& second = shard.frequencies[(block * 0xbf58476d1ce4e5b9 >> 17) % n];
+    uint8_t count = std::min(first, second);
+    if (count < UINT8_MAX) {
+        count++;
+        first = std::max(first, count);
+        second = std::max(second, count);
+    }
+    return count;
+}
+
+template <class CFG_T>
+uint64_t BlockCache<CFG_T>::nextVictim(Shard& shard)
+{
+    // the hand clears the bits of the blocks that were read since it last
+    // passed them and stops at the first free slot or unread block
+    while (shard.referenced[shard.hand]) {
+        shard.referenced[shard.hand] = 0;
+        shard.hand = (shard.hand + 1) % slotsPerShard;
+    }
+    return shard.hand;
+}
+
+template <class CFG_T>
+bool BlockCache<CFG_T>::copyBlock(uint64_t block, char* out, uint64_t begin, uint64_t end, bool& admit)
+{
+    Shard& shard = this->shard(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    uint8_t count = countQuery(shard, block);
+    auto slot = shard.slots.find(block);
+    if (slot != shard.slots.end()) {
+        memcpy(out, shard.data + slot->second * blockSize + begin, end - begin);
+        shard.referenced[slot->second] = 1;
+        shard.credit = std::min(shard.credit + end - begin, slotsPerShard * blockSize);
+        return true;
+    }
+
+    // a block that was queried before is added to a free slot, or replaces
+    // a block that was queried less often lately if the hits paid for it, so
+    // that when the hot blocks don't fit, the ones in the cache aren't
+    // evicted for others that are as hot
+    admit = false;
+    if (count > 1) {
+        uint64_t victim = shard.blocks[nextVictim(shard)];
+        if (victim == NO_BLOCK) {
+            admit = true;
+        } else if (shard.credit >= blockSize && count > frequency(shard, victim)) {
+            admit = true;
+            shard.credit -= blockSize;
+        }
+    }
+    return false;
+}
+
+template <class CFG_T>
+void BlockCache<CFG_T>::addBlock(uint64_t block, const char* characters)
+{
+    Shard& shard = this->shard(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.slots.contains(block)) return;
+
+    // new blocks aren't marked as read and the hand moves past them, so a
+    // block that isn't read again after it's added is evicted before the
+    // blocks that are
+    uint64_t slot = nextVictim(shard);
+    shard.hand = (slot + 1) % slotsPerShard;
+    if (shard.blocks[slot] != NO_BLOCK) shard.slots.erase(shard.blocks[slot]);
+    shard.blocks[slot] = block;
+    shard.slots[block] = slot;
+    memcpy(shard.data + slot * blockSize, characters, blockSize);
+}
+
+// public
+
+template <class CFG_T>
+BlockCache<CFG_T>::BlockCache(CFG_T* cfg, const RandomAccess<CFG_T>& index, uint64_t maxBytes, uint64_t blockSize):
+    index(index), textLength(cfg->getTextLength()), blockSize(std::max((uint64_t) 1, blockSize))
+{
+    // every shard has the same number of slots, so there are fewer shards
+    // than NUM_SHARDS if there are fewer slots; every slot also holds its
+    // block's number, its bit, and its share of the query counters
+    uint64_t numSlots = maxBytes / (this->blockSize + sizeof(uint64_t) + 1 + FREQUENCIES_PER_SLOT);
+    numShards = std::max((uint64_t) 1, std::min(NUM_SHARDS, numSlots / MIN_SHARD_SLOTS));
+    slotsPerShard = numSlots / numShards;
+    data.resize(numShards * slotsPerShard * this->blockSize);
+    shards = std::make_unique<Shard[]>(numShards);
+    for (uint64_t s = 0; s < numShards; s++) {
+        shards[s].slots.reserve(slotsPerShard);
+        shards[s].blocks.assign(slotsPerShard, NO_BLOCK);
+        shards[s].referenced.assign(slotsPerShard, 0);
+        shards[s].frequencies.assign(FREQUENCIES_PER_SLOT * slotsPerShard, 0);
+        shards[s].data = data.data() + s * slotsPerShard * this->blockSize;
+    }
+}
+
+template <class CFG_T>
+void BlockCache<CFG_T>::get(Context& context, char* out, uint64_t begin, uint64_t end)
+{
+    if (slotsPerShard == 0) {
+        index.get(context.index, out, begin, end);
+        return;
+    }
+
+    // the blocks that miss and aren't admitted are only decoded as far as
+    // the query needs them, and consecutive ones are decoded with one query
+    // from missBegin when the range ends or reaches a block that isn't
+    char* missOut = out;
+    uint64_t missBegin = begin;
+    for (uint64_t block = begin / blockSize; begin < end; block++) {
+        uint64_t blockBegin = block * blockSize;
+        uint64_t blockEnd = std::min(blockBegin + blockSize, end);
+        bool admit = false;
+        bool hit = copyBlock(block, out, begin - blockBegin, blockEnd - blockBegin, admit);
+        if (hit || admit) {
+            if (missBegin < begin) index.get(context.index, missOut, missBegin, begin);
+            missOut = out + (blockEnd - begin);
+            missBegin = blockEnd;
+        }
+        if (hit) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (admit) {
+            context.block.resize(blockSize);
+            index.get(context.index, context.block.data(), blockBegin, std::min(blockBegin + blockSize, textLength));
+            addBlock(block, context.block.data());
+            memcpy(out, context.block.data() + begin - blockBegin, blockEnd - begin);
+        }
+        out += blockEnd - begin;
+        begin = blockEnd;
+    }
+    if (missBegin < end) index.get(context.index, missOut, missBegin, end);
+}
+
+// instantiate the class
+template class BlockCache<CFG<JaggedArrayBpHeader<>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<>>>;
+template class BlockCache<CFG<JaggedArrayInt<>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>>;
+template class BlockCache<CFG<JaggedArrayIntFlat<>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpWord>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>>;
+template class BlockCache<CFG<JaggedArrayIntEF<>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpEF>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>>;
+template class BlockCache<CFG<JaggedArrayDac<>>>;
+template class BlockCache<CFG<JaggedArrayPair<>>>;
+template class BlockCache<CFG<JaggedArrayPairBp<>>>;
+template class BlockCache<CFG<JaggedArrayBpHeader<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayInt<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayIntFlat<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayIntEF<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayDac<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayPair<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayPairBp<uint64_t>>>;
+template class BlockCache<CFG<JaggedArrayVirtual<JaggedArrayInt<>>>>;
+template class BlockCache<CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>>;
+template class BlockCache<CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>>;
+template class BlockCache<CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>>;
+
+}
@@ -1,61 +1,208 @@
 #include <algorithm>
-#include <cstdio>
-#include <fstream>
-#include <map>
-#include <sys/stat.h>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "fras/array/jagged_array_bp_header.hpp"
 #include "fras/array/jagged_array_bp_index.hpp"
 #include "fras/array/jagged_array_bp_mono.hpp"
 #include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
 #include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include "fras/array/parallel.hpp"
 #include "fras/cfg/cfg.hpp"
+#include "fras/cfg/repair.hpp"
 
 namespace fras {
 
 // private
 
-template <class JaggedArray_T>
-void CFG<JaggedArray_T>::computeDepthAndTextSize(uint64_t* ruleSizes, int* ruleDepths, int rule)
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::checkSizes(uint64_t numRules, uint64_t rulesSize, uint64_t startSize)
 {
-    if (ruleSizes[rule] != 0) return;
+    // the start rule's index is the last array index
+    if (numRules >= std::numeric_limits<Symbol>::max() - CFG::ALPHABET_SIZE) {
+        throw std::runtime_error("the grammar has too many rules for its symbol type");
+    }
+    // +1 for the dummy code
+    if (rulesSize >= std::numeric_limits<Offset>::max() || startSize >= std::numeric_limits<Offset>::max()) {
+        throw std::runtime_error("the grammar's rules are too long for its offset type");
+    }
+}
 
-    int c;
-    for (int i = 0; (c = get(rule, i)) != CFG::DUMMY_CODE; i++) {
-        if (ruleSizes[c] == 0) {
-            computeDepthAndTextSize(ruleSizes, ruleDepths, c);
+// the fewest rules that are worth remapping or encoding in their own thread
+static const uint64_t THREAD_RULES = (uint64_t) 1 << 20;
+
+template <JaggedArrayType JaggedArray_T>
+template <class Characters>
+void CFG<JaggedArray_T>::computeRuleStatistics(Characters characters, uint64_t* ruleSizes, Symbol* ruleDepths, Symbol* ruleReferences)
+{
+    for (Symbol i = 0; i < CFG::ALPHABET_SIZE; i++) {
+        ruleSizes[i] = 1;
+        ruleDepths[i] = 1;
+        ruleReferences[i] = 0;
+    }
+    for (Symbol i = CFG::ALPHABET_SIZE; i <= startRule; i++) {
+        ruleSizes[i] = 0;
+        ruleDepths[i] = 0;
+        ruleReferences[i] = 0;
+    }
+
+    // reference counts are only updated atomically if there are several threads
+    uint64_t threads = numThreads(numRules + 1, THREAD_RULES);
+    auto reference = [&](Symbol c, Symbol delta) {
+        if (c < CFG::ALPHABET_SIZE) return;
+        if (threads == 1) {
+            ruleReferences[c] += delta;
+        } else {
+            std::atomic_ref<Symbol>(ruleReferences[c]).fetch_add(delta, std::memory_order_relaxed);
+        }
+    };
+
+    // resolves a rule if all of its characters are resolved; a rule's depth is
+    // set after its size, so a rule is resolved once its depth isn't 0 and
+    // threads can use the rules other threads resolve in the same round. The
+    // characters are counted as they're visited and uncounted if the rule
+    // can't be resolved yet, which is rare
+    auto resolve = [&](Symbol rule) {
+        uint64_t size = 0;
+        Symbol depth = 0;
+        uint64_t visited = 0;
+        bool resolved = true;
+        characters(rule, [&](Symbol c) {
+            if (c >= startRule) {
+                throw std::runtime_error("the grammar has a character that isn't a rule");
+            }
+            Symbol d = std::atomic_ref<Symbol>(ruleDepths[c]).load(std::memory_order_acquire);
+            if (d == 0) {
+                resolved = false;
+                return false;
+            }
+            size += ruleSizes[c];
+            depth = std::max(depth, d);
+            reference(c, 1);
+            visited++;
+            return true;
+        });
+        if (!resolved) {
+            characters(rule, [&](Symbol c) {
+                if (visited == 0) return false;
+                visited--;
+                reference(c, (Symbol) -1);
+                return true;
+            });
+            return false;
+        }
+        ruleSizes[rule] = size;
+        std::atomic_ref<Symbol>(ruleDepths[rule]).store(depth + 1, std::memory_order_release);
+        return true;
+    };
+
+    // every thread goes through its range of rules in order and keeps the
+    // rules it couldn't resolve for the next round. Grammar compressors add
+    // rules after the rules they use, so there are usually about as many
+    // rounds as threads, and never more than the grammar's depth
+    std::vector<std::vector<Symbol>> pending(threads);
+    std::vector<uint8_t> progress(threads);
+    for (bool first = true; ; first = false) {
+        runInParallel(threads, [&](uint64_t thread) {
+            std::vector<Symbol>& left = pending[thread];
+            uint64_t numPending = left.size();
+            if (first) {
+                Symbol begin = CFG::ALPHABET_SIZE + (numRules + 1) * thread / threads;
+                Symbol end = CFG::ALPHABET_SIZE + (numRules + 1) * (thread + 1) / threads;
+                for (Symbol rule = begin; rule < end; rule++) {
+                    if (!resolve(rule)) left.push_back(rule);
+                }
+                numPending = end - begin;
+            } else {
+                uint64_t n = 0;
+                for (Symbol rule : left) {
+                    if (!resolve(rule)) left[n++] = rule;
+                }
+                left.resize(n);
+            }
+            progress[thread] = (left.size() < numPending);
+        });
+
+        bool done = true;
+        bool resolved = false;
+        for (uint64_t i = 0; i < threads; i++) {
+            done = done && pending[i].empty();
+            resolved = resolved || progress[i];
+        }
+        if (done) break;
+        if (!resolved) {
+            throw std::runtime_error("the grammar's rules are cyclic");
         }
-        ruleSizes[rule] += ruleSizes[c];
-        ruleDepths[rule] = std::max(ruleDepths[rule], ruleDepths[c]);
     }
-    ruleDepths[rule]++;
 }
 
-template <class JaggedArray_T>
-void CFG<JaggedArray_T>::reorderRules(uint64_t* ruleSizes)
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::computeRuleStatistics()
 {
-    // count how many times each expansion length occurs
-    std::map<uint64_t, int> sizeMap;
-    uint64_t size;
-    for (int i = CFG::ALPHABET_SIZE; i < startRule; i++) {
-        size = ruleSizes[i];
-        if (!sizeMap.contains(size)) {
-            sizeMap[size] = 0;
+    uint64_t* ruleSizes = new uint64_t[startRule + 1];
+    Symbol* ruleDepths = new Symbol[startRule + 1];
+    referenceCounts.resize((uint64_t) startRule + 1);
+    computeRuleStatistics([&](Symbol rule, auto visit) {
+        Symbol c;
+        for (Offset i = 0; (c = get(rule, i)) != CFG::DUMMY_CODE; i++) {
+            if (!visit(c)) return;
         }
-        sizeMap[size] += 1;
+    }, ruleSizes, ruleDepths, referenceCounts.data());
+
+    // the rules are already ordered by expansion size
+    expansionSizes = ExpansionSizes();
+    for (Symbol i = 0; i <= startRule; i++) {
+        expansionSizes.add(i, ruleSizes[i]);
     }
 
-    // compute the last occurrence of each expansion length in the new ordering
-    int offset = CFG::ALPHABET_SIZE - 1;
-    int nextOffset = offset;
+    delete[] ruleSizes;
+    delete[] ruleDepths;
+}
+
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::reorderRules(uint64_t* ruleSizes, Symbol* newOrdering, Symbol* newOrderingReversed)
+{
+    // count how many times each expansion length occurs; the lengths are
+    // hashed and only the distinct lengths are sorted
+    std::unordered_map<uint64_t, Symbol> sizeMap;
+    uint64_t size;
+    for (Symbol i = CFG::ALPHABET_SIZE; i < startRule; i++) {
+        sizeMap[ruleSizes[i]] += 1;
+    }
+    std::vector<uint64_t> sizes;
+    sizes.reserve(sizeMap.size());
     for (auto& [size, count] : sizeMap) {
+        sizes.push_back(size);
+    }
+    std::sort(sizes.begin(), sizes.end());
+
+    // compute the last occurrence of each expansion length in the new ordering
+    Symbol offset = CFG::ALPHABET_SIZE - 1;
+    Symbol nextOffset = offset;
+    for (uint64_t size : sizes) {
+        Symbol& count = sizeMap[size];
         nextOffset += count;
         count += offset;
         offset = nextOffset;
     }
 
-    // assign new rule characters using the last occurrences
-    int* newOrdering = new int[startRule + 1];
-    int* newOrderingReversed = new int[startRule + 1];
-    for (int i = CFG::ALPHABET_SIZE; i < startRule; i++) {
+    // assign new rule characters using the last occurrences; characters keep
+    // their codes so that any symbol can be renumbered without a branch
+    for (Symbol i = 0; i < CFG::ALPHABET_SIZE; i++) {
+        newOrdering[i] = i;
+    }
+    for (Symbol i = CFG::ALPHABET_SIZE; i < startRule; i++) {
         size = ruleSizes[i];
         newOrdering[i] = sizeMap[size]--;
         newOrderingReversed[newOrdering[i]] = i;
@@ -63,52 +210,78 @@ void CFG<JaggedArray_T>::reorderRules(uint64_t* ruleSizes)
     newOrdering[startRule] = startRule;
     newOrderingReversed[startRule] = startRule;
 
-    // reorder the rules and update characters
-    // NOTE: assigning rules in order is required by some jagged arrays
-    JaggedArray_T* newRules = new JaggedArray_T(startRule + 1);
-    int* ruleBuffer = new int[startSize + 1];  // +1 for the dummy code
-    int c, newIndex;
-    for (int i = CFG::ALPHABET_SIZE; i <= startRule; i++) {
-        int oldIndex = newOrderingReversed[i];
-        int j = 0;
-        do {
-            c = this->get(oldIndex, j);
-            if (c < CFG::ALPHABET_SIZE) {
-                ruleBuffer[j] = c;
-            } else {
-                ruleBuffer[j] = newOrdering[c];
-            }
-            j += 1;
-        } while (c != CFG::DUMMY_CODE);
-        setRule(newRules, i, ruleBuffer, j);
-        clearRule(rules, oldIndex);
+    // every size's rules now begin one after its entry in the size map
+    expansionSizes = ExpansionSizes();
+    expansionSizes.add(0, 1);
+    for (uint64_t size : sizes) {
+        expansionSizes.add(sizeMap[size] + 1, size);
     }
-    delete rules;
-    rules = newRules;
-
-    // clean up
-    delete[] ruleBuffer;
-    delete[] newOrdering;
-    delete[] newOrderingReversed;
+    expansionSizes.add(startRule, ruleSizes[startRule]);
 }
 
-template <class JaggedArray_T>
-void CFG<JaggedArray_T>::postProcess()
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::encodeRules(RawRules& raw, Symbol* newOrdering, Symbol* newOrderingReversed)
 {
-    // prepare post-processing structures
-    uint64_t* ruleSizes = new uint64_t[startRule + 1];
-    int* ruleDepths = new int[startRule + 1];
-    for (int i = 0; i < CFG::ALPHABET_SIZE; i++) {
-        ruleSizes[i] = 1;
-        ruleDepths[i] = 1;
+    rules = createRules(startRule + 1);
+
+    // fills the buffer with rule i of the new ordering, its characters renumbered
+    auto fillRule = [&](Symbol i, std::vector<Symbol>& ruleBuffer) {
+        uint64_t oldIndex = newOrderingReversed[i] - CFG::ALPHABET_SIZE;
+        uint64_t ruleBegin = raw.begin(oldIndex, numRules);
+        uint64_t length = raw.begin(oldIndex + 1, numRules) - ruleBegin;
+        ruleBuffer.resize(length + 1);  // +1 for the dummy code
+        for (uint64_t j = 0; j < length; j++) {
+            ruleBuffer[j] = newOrdering[raw.characters[ruleBegin + j]];
+        }
+        ruleBuffer[length] = CFG::DUMMY_CODE;
+    };
+
+    // jagged arrays that set rules in batches, e.g. to compute their pack
+    // widths with a parallel scan, set every rule at once
+    if constexpr (BatchJaggedArrayType<JaggedArray_T>) {
+        if (allocation == Allocation::MALLOC) {
+            rules->setArrays(CFG::ALPHABET_SIZE, startRule + 1, numThreads(numRules, THREAD_RULES), fillRule);
+            return;
+        }
     }
-    for (int i = CFG::ALPHABET_SIZE; i <= startRule; i++) {
-        ruleSizes[i] = 0;
-        ruleDepths[i] = 0;
+
+    // sets rules [begin, end) of the new ordering
+    auto setRules = [&](Symbol begin, Symbol end) {
+        std::vector<Symbol> ruleBuffer;
+        for (Symbol i = begin; i < end; i++) {
+            fillRule(i, ruleBuffer);
+            setRule(rules, i, ruleBuffer.data(), ruleBuffer.size());
+        }
+    };
+
+    // NOTE: assigning rules in order is required by some jagged arrays; the
+    // others are set from several threads and the start rule is set last
+    uint64_t threads = 1;
+    if constexpr (ConcurrentJaggedArrayType<JaggedArray_T>) {
+        if (allocation == Allocation::MALLOC) {
+            threads = numThreads(numRules, THREAD_RULES);
+        }
     }
+    runInParallel(threads, [&](uint64_t thread) {
+        setRules(CFG::ALPHABET_SIZE + numRules * thread / threads, CFG::ALPHABET_SIZE + numRules * (thread + 1) / threads);
+    });
+    setRules(startRule, startRule + 1);
+}
 
-    // compute the depth and text length
-    computeDepthAndTextSize(ruleSizes, ruleDepths, startRule);
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::postProcess(RawRules& raw)
+{
+    // compute the expansion sizes, depths and reference counts
+    uint64_t* ruleSizes = new uint64_t[startRule + 1];
+    Symbol* ruleDepths = new Symbol[startRule + 1];
+    referenceCounts.resize((uint64_t) startRule + 1);
+    computeRuleStatistics([&](Symbol rule, auto visit) {
+        uint64_t i = rule - CFG::ALPHABET_SIZE;
+        uint64_t end = raw.begin(i + 1, numRules);
+        for (uint64_t j = raw.begin(i, numRules); j < end; j++) {
+            if (!visit(raw.characters[j])) return;
+        }
+    }, ruleSizes, ruleDepths, referenceCounts.data());
     textLength = ruleSizes[startRule];
     depth = ruleDepths[startRule];
 
@@ -116,241 +289,443 @@ void CFG<JaggedArray_T>::postProcess()
     delete[] ruleDepths;
 
     // order the rules by expansion length, shortest to longest
-    reorderRules(ruleSizes);
+    Symbol* newOrdering = new Symbol[startRule + 1];
+    Symbol* newOrderingReversed = new Symbol[startRule + 1];
+    reorderRules(ruleSizes, newOrdering, newOrderingReversed);
 
-    // clean up rule sizes
+    // clean up rule sizes before the rules are encoded so they aren't part of the peak memory
     delete[] ruleSizes;
+
+    // encode the rules once, in the new order
+    encodeRules(raw, newOrdering, newOrderingReversed);
+    std::vector<Symbol>().swap(raw.characters);
+    std::vector<uint64_t>().swap(raw.begins);
+
+    // move the reference counts to the new ordering now that the raw rules
+    // are freed, so the copy isn't part of the peak memory
+    std::vector<Symbol> counts((uint64_t) startRule + 1);
+    for (Symbol i = 0; i <= startRule; i++) {
+        counts[newOrdering[i]] = referenceCounts[i];
+    }
+    referenceCounts.swap(counts);
+
+    // clean up
+    delete[] newOrdering;
+    delete[] newOrderingReversed;
 }
 
 // load grammars
 
-template <class JaggedArray_T>
-CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromMrRepairFile(std::string filename)
+// the smallest part of an MR-RePair file that's worth parsing in its own thread
+static const uint64_t MR_REPAIR_CHUNK_SIZE = (uint64_t) 1 << 24;
+
+// parses the next integer in an MR-RePair file, skipping the whitespace
+// before it; returns NULL if there are no more integers
+static const char* parseMrRepairInteger(const char* p, const char* end, int64_t& value)
+{
+    while (p < end && (*p == '\n' || *p == '\r' || *p == ' ' || *p == '\t')) p++;
+    if (p == end) return NULL;
+
+    bool negative = (*p == '-');
+    if (negative) p++;
+    const char* digits = p;
+    uint64_t v = 0;
+    for (unsigned d; p < end && (d = (unsigned char) *p - '0') < 10; p++) {
+        v = 10 * v + d;
+    }
+    if (p == digits || (p < end && *p != '\n' && *p != '\r' && *p != ' ' && *p != '\t')) {
+        throw std::runtime_error("malformed MR-RePair grammar");
+    }
+    value = negative ? -(int64_t) v : (int64_t) v;
+    return p;
+}
+
+// the position after the first rule terminator, i.e. a -1 line, at or after p
+// in the rules that start at begin, or end if there are no more terminators
+static const char* nextMrRepairRule(const char* p, const char* begin, const char* end)
 {
-    std::ifstream reader(filename);
-    std::string line;
-
-    // read grammar specs
-    std::getline(reader, line);
-    int textLength = std::stoi(line);
-    std::getline(reader, line);
-    int numRules = std::stoi(line);
-    std::getline(reader, line);
-    int startSize = std::stoi(line);
-
-    // prepare to read grammar
-    CFG* cfg = new CFG<JaggedArray_T>(numRules);
-    cfg->textLength = std::stoi(line);
-    cfg->startSize = std::stoi(line);
-
-    // assume the start rule is the largest to create a rule buffer
-    int* ruleBuffer = new int[cfg->startSize + 1];  // +1 for the dummy code
-    int j, c, ruleLength;
-
-    // read rules in the order they were added to grammar, i.e. line-by-line
-    for (int i = CFG::ALPHABET_SIZE; i < cfg->startRule; i++) {
-        int j = 0;
-        std::getline(reader, line);
-        c = std::stoi(line);
-        while ((c = std::stoi(line)) != -1) {
-            ruleBuffer[j++] = c;
-            std::getline(reader, line);
+    std::string_view text(begin, end - begin);
+    for (uint64_t i = p - begin; (i = text.find("-1", i)) != std::string_view::npos; i += 2) {
+        bool lineBegin = (i == 0 || text[i - 1] == '\n');
+        bool lineEnd = (i + 2 == text.size() || text[i + 2] == '\n' || text[i + 2] == '\r');
+        if (lineBegin && lineEnd) {
+            return begin + i + 2;
         }
-        ruleBuffer[j++] = CFG::DUMMY_CODE;
-        cfg->rulesSize += j;
-        cfg->setRule(i, ruleBuffer, j);
     }
+    return end;
+}
 
-    // read start rule
-    for (int i = 0; i < cfg->startSize; i++) {
-        // get the (non-)terminal character
-        std::getline(reader, line);
-        c = std::stoi(line);
-        ruleBuffer[i] = c;
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::parseMrRepairChunk(const char* begin, const char* end, std::vector<Symbol>& values)
+{
+    // every integer takes at least two characters
+    values.reserve((end - begin) / 4);
+    int64_t value;
+    for (const char* p = begin; (p = parseMrRepairInteger(p, end, value)) != NULL;) {
+        if (value < -1) {
+            throw std::runtime_error("malformed MR-RePair grammar");
+        }
+        values.push_back((value == -1) ? CFG::DUMMY_CODE : (Symbol) value);
+    }
+}
+
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromMrRepairFile(std::string filename, Allocation allocation)
+{
+    uint64_t numRules;
+    uint64_t startSize;
+    std::vector<std::vector<Symbol>> chunks;
+
+    // the file is unmapped once it's parsed so it isn't part of the peak memory
+    {
+        MappedFile file(filename);
+        const char* begin = file.getData();
+        const char* end = begin + file.getSize();
+
+        // read grammar specs; the text length is computed by postProcess
+        int64_t specs[3];
+        for (int i = 0; i < 3; i++) {
+            begin = parseMrRepairInteger(begin, end, specs[i]);
+            if (begin == NULL || specs[i] < 0) {
+                throw std::runtime_error("malformed MR-RePair grammar");
+            }
+        }
+        numRules = specs[1];
+        startSize = specs[2];
+        checkSizes(numRules, 0, startSize);
+
+        // split the rules into chunks that start at rules so they can be parsed in parallel
+        uint64_t numChunks = numThreads(end - begin, MR_REPAIR_CHUNK_SIZE);
+        std::vector<const char*> bounds(numChunks + 1);
+        bounds[0] = begin;
+        bounds[numChunks] = end;
+        for (uint64_t i = 1; i < numChunks; i++) {
+            const char* p = begin + (end - begin) * i / numChunks;
+            bounds[i] = nextMrRepairRule(std::max(p, bounds[i - 1]), begin, end);
+        }
+
+        // parse the chunks
+        chunks.resize(numChunks);
+        runInParallel(numChunks, [&](uint64_t i) {
+            parseMrRepairChunk(bounds[i], bounds[i + 1], chunks[i]);
+        });
+    }
+
+    // collect the rules in the order they were added to grammar; each ends
+    // with a dummy code and the start rule follows the last of them
+    RawRules raw;
+    uint64_t numValues = 0;
+    for (std::vector<Symbol>& values : chunks) {
+        numValues += values.size();
+    }
+    raw.characters.reserve(numValues);
+    raw.begins.reserve(numRules + 2);
+    raw.begins.push_back(0);
+    for (std::vector<Symbol>& values : chunks) {
+        for (Symbol c : values) {
+            if (c == CFG::DUMMY_CODE && raw.begins.size() <= numRules) {
+                raw.begins.push_back(raw.characters.size());
+            } else {
+                raw.characters.push_back(c);
+            }
+        }
+        std::vector<Symbol>().swap(values);
+    }
+    if (raw.begins.size() <= numRules || raw.characters.size() - raw.begins[numRules] < startSize) {
+        throw std::runtime_error("the MR-RePair grammar is truncated");
     }
-    ruleBuffer[cfg->startSize] = CFG::DUMMY_CODE;
-    cfg->setRule(cfg->startRule, ruleBuffer, cfg->startSize + 1);
+    uint64_t rulesSize = raw.begins[numRules] + numRules;  // +1 dummy code per rule
+    checkSizes(numRules, rulesSize, startSize);
 
-    // compute grammar depth and text length
-    cfg->postProcess();
+    // the start rule is the first startSize values after the rules
+    raw.characters.resize(raw.begins[numRules] + startSize);
+    raw.begins.push_back(raw.characters.size());
 
-    // cleanup
-    delete[] ruleBuffer;
+    // compute grammar depth and text length and encode the rules
+    CFG* cfg = new CFG<JaggedArray_T>(numRules, allocation);
+    cfg->rulesSize = rulesSize;
+    cfg->startSize = startSize;
+    cfg->postProcess(raw);
 
     return cfg;
 }
 
 // construction from Navarro grammar
 
-template <class JaggedArray_T>
-CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromNavarroFiles(std::string filenameC, std::string filenameR)
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::remapNavarroSymbols(const char* symbols, uint64_t length, const unsigned char* map, int alphabetSize, Symbol* values)
 {
-    typedef struct { int left, right; } Tpair;
-
-    // get the .R file size
-    struct stat s;
-    stat(filenameR.c_str(), &s);
-    int len = s.st_size;
-
-    // open the .R file
-    FILE* rFile = fopen(filenameR.c_str(), "r");
-
-    // read the alphabet size
-    int alphabetSize;
-    fread(&alphabetSize, sizeof(int), 1, rFile);
-    int numRules = (len - sizeof(int) - alphabetSize) / sizeof(Tpair);
-    CFG* cfg = new CFG<JaggedArray_T>(numRules);
-    cfg->rulesSize = numRules * 2;  // each rule is a pair
-
-    // read the alphabet map, i.e. \Sigma -> [0..255]
-    char map[256];
-    fread(&map, sizeof(char), alphabetSize, rFile);
+    for (uint64_t i = 0; i < length; i++) {
+        int t;
+        memcpy(&t, symbols + sizeof(int) * i, sizeof(int));
+        // characters are mapped back to bytes and rules are offset past them
+        Symbol c = map[t & (CFG::ALPHABET_SIZE - 1)];
+        Symbol rule = (Symbol) (t - alphabetSize + CFG::ALPHABET_SIZE);
+        values[i] = (t < alphabetSize) ? c : rule;
+    }
+}
 
-    // prepare to read grammar
-    int* ruleBuffer = new int[3];  // +1 for the dummy code
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromNavarroFiles(std::string filenameC, std::string filenameR, Allocation allocation)
+{
+    typedef struct { int left, right; } Tpair;
 
-    // read the rule pairs
-    Tpair p;
-    int c;
-    for (int i = CFG::ALPHABET_SIZE; i < cfg->startRule; i++) {
-        fread(&p, sizeof(Tpair), 1, rFile);
-        if (p.left < alphabetSize) {
-            c = (unsigned char) map[p.left];
-        } else {
-            c = p.left - alphabetSize + CFG::ALPHABET_SIZE;
+    uint64_t numRules;
+    uint64_t startSize;
+    RawRules raw;
+
+    // the files are unmapped once they're read so they aren't part of the peak memory
+    {
+        // map the .R and .C files
+        MappedFile rFile(filenameR);
+        MappedFile cFile(filenameC);
+        const char* r = rFile.getData();
+        uint64_t len = rFile.getSize();
+        startSize = cFile.getSize() / sizeof(int);
+
+        // read the alphabet size
+        int alphabetSize;
+        if (len < sizeof(int)) {
+            throw std::runtime_error("malformed Navarro grammar");
         }
-        ruleBuffer[0] = c;
-        if (p.right < alphabetSize) {
-            c = (unsigned char) map[p.right];
-        } else {
-            c = p.right - alphabetSize + CFG::ALPHABET_SIZE;
-        }
-        ruleBuffer[1] = c;
-        ruleBuffer[2] = CFG::DUMMY_CODE;
-        cfg->setRule(i, ruleBuffer, 3);
-    }
-
-    // close the .R file
-    fclose(rFile);
-
-    // get the .C file size
-    stat(filenameC.c_str(), &s);
-    cfg->startSize = s.st_size / sizeof(int);
-    // resize the buffer
-    delete[] ruleBuffer;
-    ruleBuffer = new int[cfg->startSize + 1];  // +1 for the dummy code
-
-    // open the .C file
-    FILE* cFile = fopen(filenameC.c_str(), "r");
-
-    // read the start rule
-    int t;
-    for (int i = 0; i < cfg->startSize; i++) {
-        fread(&t, sizeof(int), 1, cFile);
-        if (t < alphabetSize) {
-            c = (unsigned char) map[t];
-        } else {
-            c = t - alphabetSize + CFG::ALPHABET_SIZE;
+        memcpy(&alphabetSize, r, sizeof(int));
+        if (alphabetSize < 0 || alphabetSize > (int) CFG::ALPHABET_SIZE || len < sizeof(int) + alphabetSize) {
+            throw std::runtime_error("malformed Navarro grammar");
         }
-        ruleBuffer[i] = c;
+        numRules = (len - sizeof(int) - alphabetSize) / sizeof(Tpair);
+        checkSizes(numRules, numRules * 2, startSize);
+
+        // read the alphabet map, i.e. \Sigma -> [0..255]
+        unsigned char map[CFG::ALPHABET_SIZE] = { };
+        memcpy(map, r + sizeof(int), alphabetSize);
+        const char* pairs = r + sizeof(int) + alphabetSize;
+
+        // read the rule pairs and then the start rule
+        raw.characters.resize(2 * numRules + startSize);
+        uint64_t threads = numThreads(numRules, THREAD_RULES);
+        runInParallel(threads, [&](uint64_t thread) {
+            uint64_t begin = numRules * thread / threads;
+            uint64_t end = numRules * (thread + 1) / threads;
+            remapNavarroSymbols(pairs + sizeof(Tpair) * begin, 2 * (end - begin), map, alphabetSize, raw.characters.data() + 2 * begin);
+        });
+        remapNavarroSymbols(cFile.getData(), startSize, map, alphabetSize, raw.characters.data() + 2 * numRules);
     }
-    ruleBuffer[cfg->startSize] = CFG::DUMMY_CODE;
-    cfg->setRule(cfg->startRule, ruleBuffer, cfg->startSize + 1);
-
-    // compute grammar depth and text length
-    cfg->postProcess();
 
-    // cleanup
-    delete[] ruleBuffer;
+    // compute grammar depth and text length and encode the rules
+    CFG* cfg = new CFG<JaggedArray_T>(numRules, allocation);
+    cfg->rulesSize = numRules * 2;  // each rule is a pair
+    cfg->startSize = startSize;
+    cfg->postProcess(raw);
 
     return cfg;
 }
 
 // construction from BigRePair grammar
 
-template <class JaggedArray_T>
-CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromBigRepairFiles(std::string filenameC, std::string filenameR)
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromBigRepairFiles(std::string filenameC, std::string filenameR, Allocation allocation)
 {
     typedef struct { unsigned int left, right; } Tpair;
 
-    // get the .R file size
-    struct stat s;
-    stat(filenameR.c_str(), &s);
-    unsigned int len = s.st_size;
-
-    // open the .R file
-    FILE* rFile = fopen(filenameR.c_str(), "r");
-
-    // read the alphabet size
-    int alphabetSize;
-    fread(&alphabetSize, sizeof(int), 1, rFile);  // NOTE: alphabetSize is always 256
-    int numRules = (len - sizeof(int)) / sizeof(Tpair);
-    CFG* cfg = new CFG<JaggedArray_T>(numRules);
-    cfg->rulesSize = cfg->numRules * 2;  // each rule is a pair
-    cfg->startRule = cfg->numRules + CFG::ALPHABET_SIZE;
-
-    // prepare to read grammar
-    int* ruleBuffer = new int[cfg->startRule + 1];  // +1 for start rule
-
-    // read the rule pairs
-    Tpair p;
-    int c;
-    for (int i = CFG::ALPHABET_SIZE; i < cfg->startRule; i++) {
-        fread(&p, sizeof(Tpair), 1, rFile);
-        if (p.left < alphabetSize) {
-            c = (unsigned char) p.left;
-        } else {
-            c = p.left;  // already offset by alphabetSize
+    // the alphabet size is always 256 and rules are already offset by it, so
+    // symbols only need to be widened to the Symbol type
+    auto widen = [](const char* symbols, uint64_t length, Symbol* values) {
+        for (uint64_t i = 0; i < length; i++) {
+            unsigned int t;
+            memcpy(&t, symbols + sizeof(unsigned int) * i, sizeof(unsigned int));
+            values[i] = (Symbol) t;
         }
-        ruleBuffer[0] = c;
-        if (p.right < alphabetSize) {
-            c = (unsigned char) p.right;
-        } else {
-            c = p.right;  // already offset by alphabetSize
+    };
+
+    uint64_t numRules;
+    uint64_t startSize;
+    RawRules raw;
+
+    // the files are unmapped once they're read so they aren't part of the peak memory
+    {
+        // map the .R and .C files
+        MappedFile rFile(filenameR);
+        MappedFile cFile(filenameC);
+        uint64_t len = rFile.getSize();
+        startSize = cFile.getSize() / sizeof(unsigned int);
+        if (len < sizeof(int)) {
+            throw std::runtime_error("malformed BigRePair grammar");
         }
-        ruleBuffer[1] = c;
-        ruleBuffer[2] = CFG::DUMMY_CODE;
-        cfg->setRule(i, ruleBuffer, 3);
+        numRules = (len - sizeof(int)) / sizeof(Tpair);
+        checkSizes(numRules, numRules * 2, startSize);
+        const char* pairs = rFile.getData() + sizeof(int);
+
+        // read the rule pairs and then the start rule
+        raw.characters.resize(2 * numRules + startSize);
+        uint64_t threads = numThreads(numRules, THREAD_RULES);
+        runInParallel(threads, [&](uint64_t thread) {
+            uint64_t begin = numRules * thread / threads;
+            uint64_t end = numRules * (thread + 1) / threads;
+            widen(pairs + sizeof(Tpair) * begin, 2 * (end - begin), raw.characters.data() + 2 * begin);
+        });
+        widen(cFile.getData(), startSize, raw.characters.data() + 2 * numRules);
     }
 
-    // close the .R file
-    fclose(rFile);
+    // compute grammar depth and text length and encode the rules
+    CFG* cfg = new CFG<JaggedArray_T>(numRules, allocation);
+    cfg->rulesSize = numRules * 2;  // each rule is a pair
+    cfg->startSize = startSize;
+    cfg->postProcess(raw);
 
-    // get the .C file size
-    stat(filenameC.c_str(), &s);
-    cfg->startSize = s.st_size / sizeof(unsigned int);
+    return cfg;
+}
 
-    // open the .C file
-    FILE* cFile = fopen(filenameC.c_str(), "r");
+// construction from a text
 
-    // read the start rule
-    uint64_t pos = 0;
-    int t;
-    for (int i = 0; i < cfg->startSize; i++) {
-        fread(&t, sizeof(unsigned int), 1, cFile);
-        if (t < alphabetSize) {
-            c = (unsigned char) t;
-        } else {
-            c = t;  // already offset by alphabetSize
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromTextFile(std::string filename, Allocation allocation)
+{
+    uint64_t numRules;
+    uint64_t startSize;
+    RawRules raw;
+
+    // the text is unmapped as soon as the builder has read it and the builder
+    // is freed once the grammar is built so they aren't part of the peak memory
+    {
+        std::unique_ptr<RePair<Symbol>> repair;
+        {
+            MappedFile file(filename);
+            repair = std::make_unique<RePair<Symbol>>(file.getData(), file.getSize());
         }
-        ruleBuffer[i] = c;
+        repair->build();
+        numRules = repair->getNumRules();
+        raw.characters = repair->takeCharacters();
+        startSize = raw.characters.size() - 2 * numRules;
+        checkSizes(numRules, numRules * 2, startSize);
     }
-    ruleBuffer[cfg->startSize] = CFG::DUMMY_CODE;
-    cfg->setRule(cfg->startRule, ruleBuffer, cfg->startSize + 1);
-
-    // compute grammar depth and text length
-    cfg->postProcess();
 
-    // cleanup
-    delete[] ruleBuffer;
+    // compute grammar depth and text length and encode the rules
+    CFG* cfg = new CFG<JaggedArray_T>(numRules, allocation);
+    cfg->rulesSize = numRules * 2;  // each rule is a pair
+    cfg->startSize = startSize;
+    cfg->postProcess(raw);
 
     return cfg;
 }
 
+// rule statistics
+
+template <JaggedArrayType JaggedArray_T>
+typename CFG<JaggedArray_T>::ExpansionSizes CFG<JaggedArray_T>::takeExpansionSizes()
+{
+    if (expansionSizes.sizes.empty()) {
+        computeRuleStatistics();
+    }
+    return std::move(expansionSizes);
+}
+
+template <JaggedArrayType JaggedArray_T>
+std::vector<typename CFG<JaggedArray_T>::Symbol> CFG<JaggedArray_T>::takeReferenceCounts()
+{
+    if (referenceCounts.empty()) {
+        computeRuleStatistics();
+    }
+    return std::move(referenceCounts);
+}
+
+// serialization
+
+// identifies serialized grammar files
+static const char SERIALIZED_MAGIC[8] = { 'F', 'R', 'A', 'S', 'C', 'F', 'G', '\0' };
+
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>::CFG(std::shared_ptr<MappedFile> file) requires (SERIALIZABLE): allocation(Allocation::MALLOC), file(file)
+{
+    textLength = file->readValue<uint64_t>();
+    numRules = file->readValue<Symbol>();
+    startRule = numRules + CFG::ALPHABET_SIZE;
+    rulesSize = file->readValue<Offset>();
+    startSize = file->readValue<Offset>();
+    depth = file->readValue<Symbol>();
+    rules = new JaggedArray_T(*file);
+}
+
+template <JaggedArrayType JaggedArray_T>
+CFG<JaggedArray_T>* CFG<JaggedArray_T>::fromSerializedFile(std::shared_ptr<MappedFile> file) requires SERIALIZABLE
+{
+    // check the header
+    if (memcmp(file->readArray<char>(sizeof(SERIALIZED_MAGIC)), SERIALIZED_MAGIC, sizeof(SERIALIZED_MAGIC)) != 0) {
+        throw std::runtime_error("the file is not a serialized grammar");
+    }
+    // a different byte order also changes the version
+    if (file->readValue<uint32_t>() != CFG::SERIALIZATION_VERSION) {
+        throw std::runtime_error("the serialized grammar has an unsupported version or byte order");
+    }
+    uint64_t length = file->readValue<uint64_t>();
+    std::string encoding(file->readArray<char>(length), length);
+    if (encoding != JaggedArray_T::ENCODING) {
+        throw std::runtime_error("the serialized grammar was written with a different encoding");
+    }
+
+    return new CFG<JaggedArray_T>(file);
+}
+
+template <JaggedArrayType JaggedArray_T>
+void CFG<JaggedArray_T>::serialize(std::ostream& out) requires SERIALIZABLE
+{
+    // write the header
+    writeArray(out, SERIALIZED_MAGIC, sizeof(SERIALIZED_MAGIC));
+    writeValue(out, CFG::SERIALIZATION_VERSION);
+    std::string encoding = JaggedArray_T::ENCODING;
+    writeValue<uint64_t>(out, encoding.size());
+    writeArray(out, encoding.data(), encoding.size());
+
+    // write the grammar
+    writeValue(out, textLength);
+    writeValue(out, numRules);
+    writeValue(out, rulesSize);
+    writeValue(out, startSize);
+    writeValue(out, depth);
+    rules->serialize(out);
+}
+
 // instantiate the class
-template class CFG<JaggedArrayBpIndex>;
-template class CFG<JaggedArrayBpMono>;
-template class CFG<JaggedArrayBpOpt>;
-template class CFG<JaggedArrayInt>;
+template class CFG<JaggedArrayBpHeader<>>;
+template class CFG<JaggedArrayBpIndex<>>;
+template class CFG<JaggedArrayBpMono<>>;
+template class CFG<JaggedArrayBpOpt<>>;
+template class CFG<JaggedArrayInt<>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>;
+template class CFG<JaggedArrayIntFlat<>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpWord>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>;
+template class CFG<JaggedArrayIntEF<>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpEF>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>;
+template class CFG<JaggedArrayDac<>>;
+template class CFG<JaggedArrayPair<>>;
+template class CFG<JaggedArrayPairBp<>>;
+template class CFG<JaggedArrayBpHeader<uint64_t>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>;
+template class CFG<JaggedArrayInt<uint64_t>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>;
+template class CFG<JaggedArrayIntFlat<uint64_t>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>;
+template class CFG<JaggedArrayIntEF<uint64_t>>;
+template class CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>;
+template class CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>;
+template class CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>;
+template class CFG<JaggedArrayDac<uint64_t>>;
+template class CFG<JaggedArrayPair<uint64_t>>;
+template class CFG<JaggedArrayPairBp<uint64_t>>;
+template class CFG<JaggedArrayVirtual<JaggedArrayInt<>>>;
+template class CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>;
+template class CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>;
+template class CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>;
 
 }
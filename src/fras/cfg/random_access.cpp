@@ -1,47 +1,107 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
 #include <stdexcept>
+#include "fras/array/jagged_array_bp_header.hpp"
 #include "fras/array/jagged_array_bp_index.hpp"
 #include "fras/array/jagged_array_bp_mono.hpp"
 #include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/jagged_array_dac.hpp"
 #include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include "fras/array/parallel.hpp"
 #include "fras/cfg/cfg.hpp"
 #include "fras/cfg/random_access.hpp"
 
 namespace fras {
 
+// the characters every thread decodes for a window of extract
+static const uint64_t EXTRACT_CHARACTERS = (uint64_t) 1 << 22;
+
 // random access
 
+template <class CFG_T>
+typename RandomAccess<CFG_T>::Offset RandomAccess<CFG_T>::skipSamples(Symbol rule, uint64_t& ignore) const
+{
+    uint64_t bit = rule - CFG_T::ALPHABET_SIZE;
+    if (sampledBits.empty() || !((sampledBits[bit / 64] >> (bit % 64)) & 1)) return 0;
+    uint64_t k = std::lower_bound(sampledRules.begin(), sampledRules.end(), rule) - sampledRules.begin();
+    const uint64_t* first = samples.data() + sampleStarts[k];
+    const uint64_t* last = samples.data() + sampleStarts[k + 1];
+
+    // the last sampled character whose expansion starts at or before the position
+    const uint64_t* sample = std::upper_bound(first, last, ignore);
+    if (sample == first) return 0;
+    ignore -= sample[-1];
+    return (sample - first) * BLOCK_SIZE;
+}
+
 //void RandomAccess::get(std::ostream& out, uint64_t begin, uint64_t end)
 template <class CFG_T>
-void RandomAccess<CFG_T>::get(char* out, uint64_t begin, uint64_t end)
+void RandomAccess<CFG_T>::get(Context& context, char* out, uint64_t begin, uint64_t end) const
 {
     //if (begin < 0 || end >= cfg->textLength || begin > end) {
     //    throw std::runtime_error("begin/end out of bounds");
     //}
+    if constexpr (CFG_T::PAIR_RULES) {
+        getPairs(context, out, begin, end);
+        return;
+    }
+    Symbol* ruleStack = context.ruleStack;
+    Offset* indexStack = context.indexStack;
+    Offset* blockIndexStack = context.blockIndexStack;
+    Offset* blockSizeStack = context.blockSizeStack;
+    Symbol* blockStack = context.blockStack;
+
     uint64_t length = end - begin;
 
     // get the start rule character to start parsing at
-    int c, rank, r = cfg->getStartRule();
+    Symbol c, r = cfg->getStartRule();
+    Offset rank;
     uint64_t selected;
     rankSelect(begin, rank, selected);
-    int i = rank - 1;
+    Offset i = rank - 1;
+
+    // characters are read from a block of the current rule that is decoded in
+    // bulk, i.e. the block holds characters [blockIndex, blockIndex + blockSize)
+    Symbol level = 0;
+    Symbol* block = blockStack;
+    Offset blockIndex = i;
+    Offset blockSize = cfg->get(r, i, BLOCK_SIZE, block);
 
     // descend the parse tree to the correct start position
-    uint64_t size, ignore = begin - selected;
-    // TODO: stacks should be preallocated to size of max depth
+    uint64_t size, ignore = begin - selected, skip = 0;
     while (ignore > 0) {
-        c = cfg->get(r, i);
+        if (i - blockIndex == blockSize) {
+            blockIndex = i;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+        c = block[i - blockIndex];
         // terminal character 
         if (c < CFG_T::ALPHABET_SIZE) {
             i++;
             ignore--;
         // non-terminal character
         } else {
-            size = expansionSize(c);
-            if (size > ignore) {
-                ruleStack.push(r);
+            size = ruleSize(c);
+            // a cached rule is copied from where the substring starts in it
+            if (size > ignore && c < cacheEnd) {
+                skip = ignore;
+                ignore = 0;
+            } else if (size > ignore) {
+                ruleStack[level] = r;
+                indexStack[level] = i + 1;
+                blockIndexStack[level] = blockIndex;
+                blockSizeStack[level] = blockSize;
+                level++;
+                block = blockStack + level * BLOCK_SIZE;
                 r = c;
-                indexStack.push(i + 1);
-                i = 0;
+                i = blockIndex = skipSamples(r, ignore);
+                blockSize = cfg->get(r, i, BLOCK_SIZE, block);
             } else {
                 ignore -= size;
                 i++;
@@ -51,33 +111,628 @@ void RandomAccess<CFG_T>::get(char* out, uint64_t begin, uint64_t end)
 
     // decode the substring
     for (uint64_t j = 0; j < length;) {
+        if (i - blockIndex == blockSize) {
+            blockIndex = i;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+        c = block[i - blockIndex];
         // end of rule
-        c = cfg->get(r, i);
         if (c == CFG_T::DUMMY_CODE) {
-            r = ruleStack.top();
-            ruleStack.pop();
-            i = indexStack.top();
-            indexStack.pop();
+            level--;
+            block = blockStack + level * BLOCK_SIZE;
+            r = ruleStack[level];
+            i = indexStack[level];
+            blockIndex = blockIndexStack[level];
+            blockSize = blockSizeStack[level];
         // terminal character 
         } else if (c < CFG_T::ALPHABET_SIZE) {
             //out << (char) c;
             out[j] = (char) c;
             i++;
             j++;
+        // cached non-terminal character
+        } else if (c < cacheEnd) {
+            const uint64_t* offsets = cacheOffsets.data() + (c - CFG_T::ALPHABET_SIZE);
+            uint64_t n = std::min(offsets[1] - offsets[0] - skip, length - j);
+            memcpy(out + j, cache.data() + offsets[0] + skip, n);
+            skip = 0;
+            i++;
+            j += n;
+        // non-terminal character
+        } else {
+            ruleStack[level] = r;
+            indexStack[level] = i + 1;
+            blockIndexStack[level] = blockIndex;
+            blockSizeStack[level] = blockSize;
+            level++;
+            block = blockStack + level * BLOCK_SIZE;
+            r = c;
+            i = blockIndex = 0;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+    }
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::getPairs(Context& context, char* out, uint64_t begin, uint64_t end) const requires CFG_T::PAIR_RULES
+{
+    uint64_t length = end - begin;
+
+    // get the start rule character to start parsing at
+    Symbol c, r = cfg->getStartRule();
+    Offset rank;
+    uint64_t selected;
+    rankSelect(begin, rank, selected);
+    Offset i = rank - 1;
+    c = cfg->get(r, i);
+
+    // the characters that remain to be decoded, i.e. the right characters of
+    // the pairs that were descended into on the left
+    Symbol* pending = context.ruleStack;
+    Symbol level = 0;
+
+    // descend the parse tree to the correct start position; a cached rule is
+    // copied from where the substring starts in it
+    Symbol left, right;
+    uint64_t size, ignore = begin - selected, skip = 0;
+    while (ignore > 0) {
+        if (c < cacheEnd) {
+            skip = ignore;
+            break;
+        }
+        cfg->getPair(c, left, right);
+        size = (left < CFG_T::ALPHABET_SIZE) ? 1 : ruleSize(left);
+        if (size > ignore) {
+            pending[level++] = right;
+            c = left;
+        } else {
+            ignore -= size;
+            c = right;
+        }
+    }
+
+    // decode the substring
+    for (uint64_t j = 0; j < length;) {
+        // terminal or cached character
+        if (c < cacheEnd) {
+            if (c < CFG_T::ALPHABET_SIZE) {
+                out[j++] = (char) c;
+            } else {
+                const uint64_t* offsets = cacheOffsets.data() + (c - CFG_T::ALPHABET_SIZE);
+                uint64_t n = std::min(offsets[1] - offsets[0] - skip, length - j);
+                memcpy(out + j, cache.data() + offsets[0] + skip, n);
+                skip = 0;
+                j += n;
+            }
+            // the next character is pending or the next in the start rule
+            c = (level > 0) ? pending[--level] : cfg->get(r, ++i);
+        // non-terminal character
+        } else {
+            cfg->getPair(c, left, right);
+            pending[level++] = right;
+            c = left;
+        }
+    }
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::getBatch(Context& context, uint64_t numRanges, const uint64_t* begins, const uint64_t* ends, char* out) const
+{
+    // the substrings are written in the order of the ranges but read in
+    // order of position, so that the cursor only moves forward
+    std::vector<uint64_t> offsets(numRanges);
+    uint64_t offset = 0;
+    for (uint64_t k = 0; k < numRanges; k++) {
+        offsets[k] = offset;
+        offset += ends[k] - begins[k];
+    }
+    std::vector<uint64_t> order(numRanges);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+        return begins[a] < begins[b];
+    });
+
+    Cursor cursor(*this, context, cfg->getTextLength());
+    for (uint64_t k : order) {
+        if (ends[k] == begins[k]) continue;
+        cursor.seek(begins[k]);
+        cursor.next(out + offsets[k], ends[k] - begins[k]);
+    }
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::getParallel(char* out, uint64_t begin, uint64_t end, uint64_t threads) const
+{
+    // a cursor can seek to any position with one descent, so the substring
+    // is split evenly instead of at the boundaries of rules
+    uint64_t length = end - begin;
+    threads = std::max((uint64_t) 1, std::min(threads, length));
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t partStart = partBegin(begin, length, threads, thread);
+        uint64_t partEnd = partBegin(begin, length, threads, thread + 1);
+        Cursor cursor(*this, partStart);
+        cursor.next(out + (partStart - begin), partEnd - partStart);
+    });
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::extract(std::ostream& out, uint64_t begin, uint64_t end, uint64_t threads) const
+{
+    // every thread keeps its cursor between windows, so it only seeks
+    // forward; the last task writes the previous window
+    uint64_t length = end - begin;
+    threads = std::max((uint64_t) 1, threads);
+    uint64_t windowSize = std::min(length, threads * EXTRACT_CHARACTERS);
+    std::vector<char> windows[2] = {std::vector<char>(windowSize), std::vector<char>(windowSize)};
+    std::vector<std::unique_ptr<Cursor>> cursors(threads);
+    uint64_t windowBegin = begin, previousSize = 0;
+    for (uint64_t w = 0; windowBegin < end || previousSize > 0; w++) {
+        uint64_t windowEnd = std::min(end, windowBegin + windowSize);
+        char* window = windows[w % 2].data();
+        char* previous = windows[(w + 1) % 2].data();
+        runInParallel(threads + 1, [&](uint64_t task) {
+            if (task == threads) {
+                out.write(previous, previousSize);
+                return;
+            }
+            uint64_t partStart = partBegin(windowBegin, windowEnd - windowBegin, threads, task);
+            uint64_t partEnd = partBegin(windowBegin, windowEnd - windowBegin, threads, task + 1);
+            if (partStart == partEnd) return;
+            if (!cursors[task]) {
+                cursors[task] = std::make_unique<Cursor>(*this, partStart);
+            } else {
+                cursors[task]->seek(partStart);
+            }
+            cursors[task]->next(window + (partStart - windowBegin), partEnd - partStart);
+        });
+        previousSize = windowEnd - windowBegin;
+        windowBegin = windowEnd;
+    }
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::cacheExpansions(uint64_t maxLength, uint64_t maxBytes)
+{
+    // a rule's characters expand to less than the rule, so they come before
+    // it and are already cached; the last offset ends the last expansion
+    cache.clear();
+    cacheOffsets.assign(1, 0);
+    Symbol rule = CFG_T::ALPHABET_SIZE;
+    for (; rule < cfg->getStartRule(); rule++) {
+        uint64_t size = expansionSize(rule);
+        if (size > maxLength || cacheMemSize() + size + sizeof(uint64_t) > maxBytes) break;
+        Offset length = cfg->ruleLength(rule);
+        uint64_t offset = cache.size();
+        cache.resize(offset + size);
+        bool cached = true;
+        for (Offset j = 0; j < length && cached; j++) {
+            Symbol c = cfg->get(rule, j);
+            if (c < CFG_T::ALPHABET_SIZE) {
+                cache[offset++] = (char) c;
+            } else if (c < rule) {
+                const uint64_t* offsets = cacheOffsets.data() + (c - CFG_T::ALPHABET_SIZE);
+                memcpy(cache.data() + offset, cache.data() + offsets[0], offsets[1] - offsets[0]);
+                offset += offsets[1] - offsets[0];
+            } else {
+                cached = false;
+            }
+        }
+        if (!cached) {
+            cache.resize(cacheOffsets.back());
+            break;
+        }
+        cacheOffsets.push_back(offset);
+    }
+    cacheEnd = rule;
+    cache.shrink_to_fit();
+    cacheOffsets.shrink_to_fit();
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::sampleRules(uint64_t minLength)
+{
+    // a rule with at most BLOCK_SIZE characters has no sample other than its
+    // first character, which isn't stored since its offset is 0
+    sampleLength = std::max(minLength, (uint64_t) BLOCK_SIZE);
+    sampledBits.assign((cfg->getNumRules() + 63) / 64, 0);
+    sampledRules.clear();
+    sampleStarts.assign(1, 0);
+    samples.clear();
+    for (Symbol rule = CFG_T::ALPHABET_SIZE; rule < cfg->getStartRule(); rule++) {
+        Offset length = cfg->ruleLength(rule);
+        if (length <= sampleLength) continue;
+        uint64_t bit = rule - CFG_T::ALPHABET_SIZE;
+        sampledBits[bit / 64] |= (uint64_t) 1 << (bit % 64);
+        sampledRules.push_back(rule);
+        uint64_t offset = 0;
+        for (Offset j = 0; j < length; j++) {
+            if (j > 0 && j % BLOCK_SIZE == 0) samples.push_back(offset);
+            Symbol c = cfg->get(rule, j);
+            offset += (c < CFG_T::ALPHABET_SIZE) ? 1 : expansionSize(c);
+        }
+        sampleStarts.push_back(samples.size());
+    }
+    if (sampledRules.empty()) sampledBits.clear();
+    sampledBits.shrink_to_fit();
+    sampledRules.shrink_to_fit();
+    sampleStarts.shrink_to_fit();
+    samples.shrink_to_fit();
+}
+
+// cursor
+
+template <class CFG_T>
+RandomAccess<CFG_T>::Cursor::Cursor(const RandomAccess& index, uint64_t position):
+    index(&index), ownContext(new Context(index.cfg)), context(ownContext.get())
+{
+    // the cursor starts past the end of the text so that the first seek
+    // descends from the start rule
+    this->position = index.cfg->getTextLength();
+    seek(position);
+}
+
+template <class CFG_T>
+RandomAccess<CFG_T>::Cursor::Cursor(const RandomAccess& index, Context& context, uint64_t position):
+    index(&index), context(&context)
+{
+    this->position = index.cfg->getTextLength();
+    seek(position);
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::Cursor::seek(uint64_t position)
+{
+    uint64_t textLength = index->cfg->getTextLength();
+    if (position >= textLength) {
+        // the next seek descends from the start rule
+        level = 0;
+        this->position = textLength;
+    } else if constexpr (CFG_T::PAIR_RULES) {
+        seekPairs(position);
+    } else {
+        seekRules(position);
+    }
+}
+
+template <class CFG_T>
+uint64_t RandomAccess<CFG_T>::Cursor::next(char* out, uint64_t n)
+{
+    n = std::min(n, index->cfg->getTextLength() - position);
+    if (n == 0) return 0;
+    if constexpr (CFG_T::PAIR_RULES) {
+        nextPairs(out, n);
+    } else {
+        nextRules(out, n);
+    }
+    return n;
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::Cursor::seekRules(uint64_t begin)
+{
+    // the state is copied to locals so that it isn't reloaded after every write
+    CFG_T* cfg = index->cfg;
+    Symbol* ruleStack = context->ruleStack;
+    Offset* indexStack = context->indexStack;
+    Offset* blockIndexStack = context->blockIndexStack;
+    Offset* blockSizeStack = context->blockSizeStack;
+    Symbol* blockStack = context->blockStack;
+    uint64_t* positionStack = context->positionStack;
+    Symbol c, r = this->r, level = this->level;
+    Symbol* block = blockStack + level * BLOCK_SIZE;
+    Offset i = this->i, blockIndex = this->blockIndex, blockSize = this->blockSize;
+    uint64_t ruleBegin = this->ruleBegin, position = this->position;
+
+    // leave the rules that end before the position, unless it's before the
+    // cursor or in another character of the start rule, in which case it's
+    // found with rank and select
+    Offset rank;
+    uint64_t selected, size;
+    index->rankSelect(begin, rank, selected);
+    if (begin < position || (level > 0 && rank != indexStack[0])) level = 0;
+    // the cursor moves back to the start of a cached character it read part of
+    position -= this->skip;
+    while (level > 0) {
+        uint64_t ruleEnd = ruleBegin + index->expansionSize(r);
+        if (begin < ruleEnd) break;
+        position = ruleEnd;
+        level--;
+        block = blockStack + level * BLOCK_SIZE;
+        r = ruleStack[level];
+        i = indexStack[level];
+        blockIndex = blockIndexStack[level];
+        blockSize = blockSizeStack[level];
+        ruleBegin = positionStack[level];
+    }
+    if (level == 0) {
+        r = cfg->getStartRule();
+        block = blockStack;
+        i = blockIndex = rank - 1;
+        blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        ruleBegin = 0;
+        position = selected;
+    }
+
+    // descend the parse tree to the position; a cached rule is read from
+    // where the position is in it
+    uint64_t ignore = begin - position, skip = 0;
+    while (ignore > 0) {
+        if (i - blockIndex == blockSize) {
+            blockIndex = i;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+        c = block[i - blockIndex];
+        // terminal character
+        if (c < CFG_T::ALPHABET_SIZE) {
+            i++;
+            ignore--;
+        // non-terminal character
+        } else {
+            size = index->ruleSize(c);
+            if (size > ignore && c < index->cacheEnd) {
+                skip = ignore;
+                ignore = 0;
+            } else if (size > ignore) {
+                ruleStack[level] = r;
+                indexStack[level] = i + 1;
+                blockIndexStack[level] = blockIndex;
+                blockSizeStack[level] = blockSize;
+                positionStack[level] = ruleBegin;
+                level++;
+                block = blockStack + level * BLOCK_SIZE;
+                r = c;
+                ruleBegin = begin - ignore;
+                i = blockIndex = index->skipSamples(r, ignore);
+                blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+            } else {
+                ignore -= size;
+                i++;
+            }
+        }
+    }
+
+    this->r = r;
+    this->level = level;
+    this->i = i;
+    this->blockIndex = blockIndex;
+    this->blockSize = blockSize;
+    this->ruleBegin = ruleBegin;
+    this->position = begin;
+    this->skip = skip;
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::Cursor::nextRules(char* out, uint64_t length)
+{
+    CFG_T* cfg = index->cfg;
+    Symbol* ruleStack = context->ruleStack;
+    Offset* indexStack = context->indexStack;
+    Offset* blockIndexStack = context->blockIndexStack;
+    Offset* blockSizeStack = context->blockSizeStack;
+    Symbol* blockStack = context->blockStack;
+    uint64_t* positionStack = context->positionStack;
+    Symbol c, r = this->r, level = this->level;
+    Symbol* block = blockStack + level * BLOCK_SIZE;
+    Offset i = this->i, blockIndex = this->blockIndex, blockSize = this->blockSize;
+    uint64_t ruleBegin = this->ruleBegin, position = this->position, skip = this->skip;
+    Symbol cacheEnd = index->cacheEnd;
+    const char* cache = index->cache.data();
+    const uint64_t* cacheOffsets = index->cacheOffsets.data();
+
+    // decode the characters; the length is in bounds, so the start rule is never left
+    for (uint64_t j = 0; j < length;) {
+        if (i - blockIndex == blockSize) {
+            blockIndex = i;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+        c = block[i - blockIndex];
+        // end of rule
+        if (c == CFG_T::DUMMY_CODE) {
+            level--;
+            block = blockStack + level * BLOCK_SIZE;
+            r = ruleStack[level];
+            i = indexStack[level];
+            blockIndex = blockIndexStack[level];
+            blockSize = blockSizeStack[level];
+            ruleBegin = positionStack[level];
+        // terminal character
+        } else if (c < CFG_T::ALPHABET_SIZE) {
+            out[j] = (char) c;
+            i++;
+            j++;
+        // cached non-terminal character, which is only read in part if the characters end in it
+        } else if (c < cacheEnd) {
+            const uint64_t* offsets = cacheOffsets + (c - CFG_T::ALPHABET_SIZE);
+            uint64_t size = offsets[1] - offsets[0];
+            uint64_t n = std::min(size - skip, length - j);
+            memcpy(out + j, cache + offsets[0] + skip, n);
+            j += n;
+            if (skip + n == size) {
+                skip = 0;
+                i++;
+            } else {
+                skip += n;
+            }
         // non-terminal character
         } else {
-            ruleStack.push(r);
+            ruleStack[level] = r;
+            indexStack[level] = i + 1;
+            blockIndexStack[level] = blockIndex;
+            blockSizeStack[level] = blockSize;
+            positionStack[level] = ruleBegin;
+            level++;
+            block = blockStack + level * BLOCK_SIZE;
             r = c;
-            indexStack.push(i + 1);
-            i = 0;
+            ruleBegin = position + j;
+            i = blockIndex = 0;
+            blockSize = cfg->get(r, i, BLOCK_SIZE, block);
+        }
+    }
+
+    this->r = r;
+    this->level = level;
+    this->i = i;
+    this->blockIndex = blockIndex;
+    this->blockSize = blockSize;
+    this->ruleBegin = ruleBegin;
+    this->position = position + length;
+    this->skip = skip;
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::Cursor::seekPairs(uint64_t begin) requires CFG_T::PAIR_RULES
+{
+    CFG_T* cfg = index->cfg;
+    Symbol* pending = context->ruleStack;
+    Symbol c = this->c, r = cfg->getStartRule(), level = this->level;
+    Offset i = this->i;
+    uint64_t position = this->position;
+
+    // skip the pending characters that end before the position, unless it's
+    // before the cursor or in another character of the start rule, in which
+    // case it's found with rank and select
+    Offset rank;
+    uint64_t selected, size;
+    index->rankSelect(begin, rank, selected);
+    if (begin < position || rank - 1 != i) {
+        level = 0;
+        i = rank - 1;
+        c = cfg->get(r, i);
+        position = selected;
+    } else {
+        // the cursor moves back to the start of a cached character it read part of
+        position -= this->skip;
+    }
+    while (level > 0) {
+        size = (c < CFG_T::ALPHABET_SIZE) ? 1 : index->ruleSize(c);
+        if (begin < position + size) break;
+        position += size;
+        c = pending[--level];
+    }
+
+    // descend the parse tree to the position; a cached rule is read from
+    // where the position is in it
+    Symbol left, right;
+    uint64_t ignore = begin - position, skip = 0;
+    while (ignore > 0) {
+        if (c < index->cacheEnd) {
+            skip = ignore;
+            break;
+        }
+        cfg->getPair(c, left, right);
+        size = (left < CFG_T::ALPHABET_SIZE) ? 1 : index->ruleSize(left);
+        if (size > ignore) {
+            pending[level++] = right;
+            c = left;
+        } else {
+            ignore -= size;
+            c = right;
         }
     }
+
+    this->c = c;
+    this->level = level;
+    this->i = i;
+    this->position = begin;
+    this->skip = skip;
+}
+
+template <class CFG_T>
+void RandomAccess<CFG_T>::Cursor::nextPairs(char* out, uint64_t length) requires CFG_T::PAIR_RULES
+{
+    CFG_T* cfg = index->cfg;
+    Symbol* pending = context->ruleStack;
+    Symbol c = this->c, r = cfg->getStartRule(), level = this->level;
+    Offset i = this->i;
+    Offset startSize = cfg->getStartSize();
+    uint64_t skip = this->skip;
+    Symbol cacheEnd = index->cacheEnd;
+    const char* cache = index->cache.data();
+    const uint64_t* cacheOffsets = index->cacheOffsets.data();
+
+    // decode the characters; the start rule isn't read past its end
+    Symbol left, right;
+    for (uint64_t j = 0; j < length;) {
+        // terminal or cached character
+        if (c < cacheEnd) {
+            if (c < CFG_T::ALPHABET_SIZE) {
+                out[j++] = (char) c;
+            } else {
+                const uint64_t* offsets = cacheOffsets + (c - CFG_T::ALPHABET_SIZE);
+                uint64_t size = offsets[1] - offsets[0];
+                uint64_t n = std::min(size - skip, length - j);
+                memcpy(out + j, cache + offsets[0] + skip, n);
+                j += n;
+                // the characters end in this one
+                if (skip + n < size) {
+                    skip += n;
+                    break;
+                }
+                skip = 0;
+            }
+            // the next character is pending or the next in the start rule
+            if (level > 0) {
+                c = pending[--level];
+            } else if (++i < startSize) {
+                c = cfg->get(r, i);
+            }
+        // non-terminal character
+        } else {
+            cfg->getPair(c, left, right);
+            pending[level++] = right;
+            c = left;
+        }
+    }
+
+    this->c = c;
+    this->level = level;
+    this->i = i;
+    this->position += length;
+    this->skip = skip;
 }
 
 // instantiate the class
-template class RandomAccess<CFG<JaggedArrayBpIndex>>;
-template class RandomAccess<CFG<JaggedArrayBpMono>>;
-template class RandomAccess<CFG<JaggedArrayBpOpt>>;
-template class RandomAccess<CFG<JaggedArrayInt>>;
+template class RandomAccess<CFG<JaggedArrayBpHeader<>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<>>>;
+template class RandomAccess<CFG<JaggedArrayInt<>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpFlat>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat>>>;
+template class RandomAccess<CFG<JaggedArrayIntFlat<>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpWord>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpWord>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpWord>>>;
+template class RandomAccess<CFG<JaggedArrayIntEF<>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpEF>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpEF>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpEF>>>;
+template class RandomAccess<CFG<JaggedArrayDac<>>>;
+template class RandomAccess<CFG<JaggedArrayPair<>>>;
+template class RandomAccess<CFG<JaggedArrayPairBp<>>>;
+template class RandomAccess<CFG<JaggedArrayBpHeader<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBp, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBp, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBp, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayInt<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpFlat, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayIntFlat<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpWord, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayIntEF<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpIndex<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpMono<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayBpOpt<JaggedArrayBpEF, uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayDac<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayPair<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayPairBp<uint64_t>>>;
+template class RandomAccess<CFG<JaggedArrayVirtual<JaggedArrayInt<>>>>;
+template class RandomAccess<CFG<JaggedArrayVirtual<JaggedArrayBpIndex<>>>>;
+template class RandomAccess<CFG<JaggedArrayVirtual<JaggedArrayBpOpt<>>>>;
+template class RandomAccess<CFG<JaggedArrayVirtual<JaggedArrayBpMono<>>>>;
 
 }
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include "fras/array/parallel.hpp"
+#include "fras/cfg/repair.hpp"
+
+namespace fras {
+
+// the fewest characters of the sequence that are worth counting or replacing in their own thread
+static const uint64_t THREAD_CHARACTERS = (uint64_t) 1 << 20;
+
+// private
+
+template <class Symbol_T>
+void RePair<Symbol_T>::countPairs(uint64_t threads)
+{
+    // the text only has bytes, so every thread counts the pairs in its part
+    // of the text in a table, and then adds up the tables for its shards
+    const uint64_t numPairs = ALPHABET_SIZE * ALPHABET_SIZE;
+    std::vector<uint64_t> tables(threads * numPairs);
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t* table = tables.data() + thread * numPairs;
+        uint64_t end = partBegin(0, sequence.size() - 1, threads, thread + 1);
+        for (uint64_t i = partBegin(0, sequence.size() - 1, threads, thread); i < end; i++) {
+            table[sequence[i] * ALPHABET_SIZE + sequence[i + 1]]++;
+        }
+    });
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t first = partBegin(0, counts.size(), threads, thread);
+        uint64_t last = partBegin(0, counts.size(), threads, thread + 1);
+        for (uint64_t i = 0; i < numPairs; i++) {
+            Pair pair(i / ALPHABET_SIZE, i % ALPHABET_SIZE);
+            uint64_t s = shard(pair);
+            if (s < first || s >= last) continue;
+            uint64_t count = 0;
+            for (uint64_t t = 0; t < threads; t++) {
+                count += tables[t * numPairs + i];
+            }
+            if (count > 0) counts[s][pair] = count;
+        }
+    });
+}
+
+template <class Symbol_T>
+bool RePair<Symbol_T>::choosePairs(uint64_t threads)
+{
+    // find the most frequent pair, and then the pairs that are at least half
+    // as frequent, in every thread's shards
+    std::vector<uint64_t> maxima(threads);
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t last = partBegin(0, counts.size(), threads, thread + 1);
+        for (uint64_t s = partBegin(0, counts.size(), threads, thread); s < last; s++) {
+            counts[s].forEach([&](const Pair&, uint64_t count) {
+                maxima[thread] = std::max(maxima[thread], count);
+            });
+        }
+    });
+    uint64_t mostFrequent = *std::max_element(maxima.begin(), maxima.end());
+    if (mostFrequent < 2) return false;
+    uint64_t minCount = std::max((uint64_t) 2, (mostFrequent + 1) / 2);
+    std::vector<std::vector<PairCount>> candidates(threads);
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t last = partBegin(0, counts.size(), threads, thread + 1);
+        for (uint64_t s = partBegin(0, counts.size(), threads, thread); s < last; s++) {
+            counts[s].forEach([&](const Pair& pair, uint64_t count) {
+                if (count >= minCount) candidates[thread].emplace_back(pair, count);
+            });
+        }
+    });
+    std::vector<PairCount> frequent;
+    for (auto& part : candidates) {
+        frequent.insert(frequent.end(), part.begin(), part.end());
+    }
+
+    // choose the most frequent pairs first; ties are broken by the pairs so
+    // that the choice doesn't depend on the order of the hash maps
+    std::sort(frequent.begin(), frequent.end(), [](auto& a, auto& b) {
+        return (a.second != b.second) ? a.second > b.second : a.first < b.first;
+    });
+    chosen.clear();
+    roles.assign(ALPHABET_SIZE + getNumRules(), 0);
+    for (auto& [pair, count] : frequent) {
+        auto [left, right] = pair;
+        if (left == right) {
+            if (roles[left] != 0) continue;
+            roles[left] = RUN;
+        } else {
+            if ((roles[left] & RIGHT) || (roles[right] & LEFT)) continue;
+            roles[left] |= LEFT;
+            roles[right] |= RIGHT;
+        }
+        if (getNumRules() >= std::numeric_limits<Symbol>::max() - ALPHABET_SIZE) {
+            throw std::runtime_error("the text has too many rules for its symbol type");
+        }
+        chosen[pair] = ALPHABET_SIZE + getNumRules();
+        rules.push_back(left);
+        rules.push_back(right);
+    }
+    return true;
+}
+
+template <class Symbol_T>
+bool RePair<Symbol_T>::startsPair(uint64_t i) const
+{
+    if (i + 1 >= sequence.size()) return false;
+    Symbol left = sequence[i];
+    Symbol right = sequence[i + 1];
+    if (roles[left] == RUN) {
+        if (left != right) return false;
+        // pairs start at even distances from the start of the run
+        uint64_t start = i;
+        while (start > 0 && sequence[start - 1] == left) start--;
+        return (i - start) % 2 == 0;
+    }
+    return (roles[left] & LEFT) && (roles[right] & RIGHT) && chosen.contains(Pair(left, right));
+}
+
+template <class Symbol_T>
+void RePair<Symbol_T>::replacePairs(uint64_t threads)
+{
+    // chosen pairs can't overlap, so whether a position is replaced only
+    // depends on the characters before it. Whether every part starts with the
+    // right character of a pair, and the character after every part and
+    // whether it's replaced, are read before any part is written
+    uint64_t length = sequence.size();
+    std::vector<uint8_t> skipFirst(threads);
+    std::vector<Symbol> next(threads);
+    std::vector<uint8_t> nextReplaced(threads);
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t begin = partBegin(0, length, threads, thread);
+        uint64_t end = partBegin(0, length, threads, thread + 1);
+        skipFirst[thread] = begin > 0 && startsPair(begin - 1);
+        if (end < length) {
+            next[thread] = sequence[end];
+            nextReplaced[thread] = startsPair(end - 1) || startsPair(end);
+        }
+    });
+
+    // every thread replaces the pairs that start in its part in place, from
+    // left to right so that runs are paired from their start, and removes the
+    // pairs that end at a replaced position, or start at one, from the counts
+    std::vector<std::vector<PairCounts>> deltas(threads, std::vector<PairCounts>(counts.size()));
+    std::vector<uint64_t> lengths(threads);
+    runInParallel(threads, [&](uint64_t thread) {
+        auto remove = [&](Symbol left, Symbol right) {
+            Pair pair(left, right);
+            deltas[thread][shard(pair)][pair]--;
+        };
+        uint64_t begin = partBegin(0, length, threads, thread);
+        uint64_t end = partBegin(0, length, threads, thread + 1);
+        uint64_t j = begin;
+
+        // the previous position's character and whether it was replaced; the
+        // pair that ends at the first position belongs to the previous part
+        Symbol previous = 0;
+        bool hasPrevious = false;
+        bool previousReplaced = false;
+        uint64_t i = begin;
+        if (skipFirst[thread]) {
+            previous = sequence[i++];
+            hasPrevious = true;
+            previousReplaced = true;
+        }
+        while (i < end) {
+            Symbol left = sequence[i];
+            Symbol right = (i + 1 < end) ? sequence[i + 1] : next[thread];
+            auto pair = chosen.end();
+            if (i + 1 < length && (roles[left] & LEFT) && (roles[right] & RIGHT)) {
+                pair = chosen.find(Pair(left, right));
+            }
+            if (pair != chosen.end()) {
+                if (hasPrevious) remove(previous, left);
+                remove(left, right);
+                sequence[j++] = pair->second;
+                previous = right;
+                previousReplaced = true;
+                i += 2;
+            } else {
+                if (hasPrevious && previousReplaced) remove(previous, left);
+                sequence[j++] = left;
+                previous = left;
+                previousReplaced = false;
+                i++;
+            }
+            hasPrevious = true;
+        }
+        // the pair that starts at the last position of the part, unless it was replaced
+        if (i == end && end < length && hasPrevious && (previousReplaced || nextReplaced[thread])) {
+            remove(previous, next[thread]);
+        }
+        lengths[thread] = j - begin;
+    });
+
+    // move the parts together
+    uint64_t newLength = lengths[0];
+    for (uint64_t thread = 1; thread < threads; thread++) {
+        uint64_t begin = partBegin(0, length, threads, thread);
+        memmove(sequence.data() + newLength, sequence.data() + begin, sizeof(Symbol) * lengths[thread]);
+        newLength += lengths[thread];
+    }
+    sequence.resize(newLength);
+
+    // add the pairs with a new rule to the counts
+    Symbol firstRule = ALPHABET_SIZE + getNumRules() - chosen.size();
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t end = partBegin(0, newLength - 1, threads, thread + 1);
+        for (uint64_t i = partBegin(0, newLength - 1, threads, thread); i < end; i++) {
+            Pair pair(sequence[i], sequence[i + 1]);
+            if (pair.first >= firstRule || pair.second >= firstRule) {
+                deltas[thread][shard(pair)][pair]++;
+            }
+        }
+    });
+
+    // every thread updates its shards of the counts
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t last = partBegin(0, counts.size(), threads, thread + 1);
+        for (uint64_t s = partBegin(0, counts.size(), threads, thread); s < last; s++) {
+            for (uint64_t t = 0; t < threads; t++) {
+                deltas[t][s].forEach([&](const Pair& pair, uint64_t delta) {
+                    counts[s][pair] += delta;
+                });
+                deltas[t][s] = PairCounts();
+            }
+        }
+    });
+}
+
+// public
+
+template <class Symbol_T>
+RePair<Symbol_T>::RePair(const char* text, uint64_t length)
+{
+    // read the text's bytes as characters
+    sequence.resize(length);
+    uint64_t threads = numThreads(length, THREAD_CHARACTERS);
+    runInParallel(threads, [&](uint64_t thread) {
+        uint64_t end = partBegin(0, length, threads, thread + 1);
+        bool zero = false;
+        for (uint64_t i = partBegin(0, length, threads, thread); i < end; i++) {
+            unsigned char c = text[i];
+            zero |= (c == 0);
+            sequence[i] = c;
+        }
+        if (zero) {
+            throw std::runtime_error("the text has a 0 byte, which is the dummy code");
+        }
+    });
+}
+
+template <class Symbol_T>
+void RePair<Symbol_T>::build()
+{
+    // the counts are split into a shard for every thread the text is split between
+    if (sequence.size() < 2) return;
+    uint64_t threads = numThreads(sequence.size(), THREAD_CHARACTERS);
+    counts.resize(threads);
+    countPairs(threads);
+
+    // every round replaces at least one pair, so the sequence gets shorter every round
+    while (sequence.size() >= 2) {
+        threads = numThreads(sequence.size(), THREAD_CHARACTERS);
+        if (!choosePairs(threads)) break;
+        replacePairs(threads);
+        numRounds++;
+    }
+    std::vector<PairCounts>().swap(counts);
+    chosen.clear();
+    std::vector<uint8_t>().swap(roles);
+}
+
+template <class Symbol_T>
+std::vector<Symbol_T> RePair<Symbol_T>::takeCharacters()
+{
+    std::vector<Symbol> characters = std::move(rules);
+    characters.insert(characters.end(), sequence.begin(), sequence.end());
+    rules.clear();
+    std::vector<Symbol>().swap(sequence);
+    return characters;
+}
+
+// instantiate the class
+template class RePair<uint32_t>;
+template class RePair<uint64_t>;
+
+}
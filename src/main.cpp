@@ -1,13 +1,29 @@
 #include <iostream>
 #include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
 #include <vector>
 
+#include "fras/array/jagged_array_dac.hpp"
 #include "fras/array/jagged_array_int.hpp"
+#include "fras/array/jagged_array_int_ef.hpp"
+#include "fras/array/jagged_array_int_flat.hpp"
+#include "fras/array/jagged_array_pair.hpp"
+#include "fras/array/jagged_array_pair_bp.hpp"
+#include "fras/array/jagged_array_virtual.hpp"
+#include "fras/array/jagged_array_bp_ef.hpp"
+#include "fras/array/jagged_array_bp_flat.hpp"
+#include "fras/array/jagged_array_bp_word.hpp"
+#include "fras/array/jagged_array_bp_header.hpp"
 #include "fras/array/jagged_array_bp_index.hpp"
 #include "fras/array/jagged_array_bp_mono.hpp"
 #include "fras/array/jagged_array_bp_opt.hpp"
+#include "fras/array/parallel.hpp"
+#include "fras/cfg/block_cache.hpp"
 #include "fras/cfg/cfg.hpp"
-//#include "fras/cfg/random_access_bv.hpp"
+#include "fras/cfg/random_access_bv.hpp"
+#include "fras/cfg/random_access_plain.hpp"
 #include "fras/cfg/random_access_sd.hpp"
 #include "xoroshiro/xoroshiro128plus.hpp"
 
@@ -15,40 +31,207 @@ using namespace std;
 using namespace fras;
 
 void usage(int argc, char* argv[]) {
-    cerr << "usage: " << argv[0] << " <type> <filename> <encoding> <querysize> [numqueries=10000] [seed=random_device]" << endl;
+    cerr << "usage: " << argv[0] << " [--index] [--threads <n>] [--extract <file>] [--cache <length>] [--cache-memory <bytes>] [--sample <length>] [--block-cache <bytes>] [--backend <backend>] <type> <filename> <encoding> <querysize> [numqueries=10000] [seed=random_device]" << endl;
     cerr << endl;
     cerr << "args: " << endl;
-    cerr << "\ttype={mrrepair|navarro|bigrepair}: the type of grammar to load" << endl;
+    cerr << "\t--index: write the loaded grammar and its random access index to <filename>.fras; flat*, word*, pair, and bppair only" << endl;
+    cerr << "\t--threads: also benchmark concurrent queries on the same index with 1, 2, 4, ... up to n threads and report the aggregate throughput; also the number of threads of --extract" << endl;
+    cerr << "\t--extract: decode the whole text in parallel and write it to <file>, using every hardware thread unless --threads is given" << endl;
+    cerr << "\t--cache: store the expansions of the rules that expand to at most <length> characters so that queries copy them instead of descending into them; the index mem size includes the cache" << endl;
+    cerr << "\t--cache-memory: the most memory the cache of --cache can use" << endl;
+    cerr << "\t--sample: sample the expansion offsets of every 16th character of the rules with more than <length> characters, at least 16, so that queries jump close to the character they descend into instead of scanning the rule; the index mem size includes the samples" << endl;
+    cerr << "\t--block-cache: also benchmark a skewed workload, where most queries are in a few hot regions of the text, without a cache of decoded text blocks, with one that uses at most <bytes> of memory, and with one too small for the hot regions; the blocks are a few queries long" << endl;
+    cerr << "\t--backend={sd|bv|plain}: the random access index to query the grammar with; defaults to sd" << endl;
+    cerr << "\t\tsd: sparse bit vectors for the start positions of the start rule's characters and the rules' expansion sizes (smallest)" << endl;
+    cerr << "\t\tbv: same as sd but with plain bit vectors and rank and select supports, which take a bit for every position of the text" << endl;
+    cerr << "\t\tplain: an array of every rule's expansion size and the sampled start positions of the start rule's characters, without rank or select (fastest)" << endl;
+    cerr << "\ttype={mrrepair|navarro|bigrepair|text|index}: the type of grammar to load" << endl;
     cerr << "\t\tmrrepair: for grammars created with the MR-RePair algorithm" << endl;
     cerr << "\t\tnavarro: for grammars created with Navarro's implementation of RePair" << endl;
     cerr << "\t\tbigrepair: for grammars created with Manzini's implementation of Big-Repair" << endl;
+    cerr << "\t\ttext: for texts, whose RePair grammar is built in parallel when they're loaded; the filename is the text file" << endl;
+    cerr << "\t\tindex: for grammars written with --index using the same encoding; the file is mapped into memory instead of parsed" << endl;
     cerr << "\tfilename: the name of the grammar file(s) without the extension(s)" << endl;
-    cerr << "\tecoding={array|bpleft|bpright|bpmono}: how the grammar should be encoded in memory" << endl;
+    cerr << "\tecoding={array|bpleft|bpright|bpmono|bpheader|flatarray|flatbpleft|flatbpright|flatbpmono|wordbpleft|wordbpright|wordbpmono|efarray|efbpleft|efbpright|efbpmono|dac|pair|bppair|dynarray|dynbpleft|dynbpright|dynbpmono}: how the grammar should be encoded in memory" << endl;
     cerr << "\t\tarray: an array of arrays (fastest)" << endl;
     cerr << "\t\tbpleft: bit packing where the pack width of a rule is detrmined by its non-terminal character" << endl;
     cerr << "\t\tbpright: bit packing where the pack width of a rule is the smallest that is compatible with every character in the rule" << endl;
     cerr << "\t\tbpmono: same as bpright but a rule's pack width cannot be less than the previous rule's width" << endl;
+    cerr << "\t\tbpheader: same as bpright but a rule's pack width and length are stored in a header at the start of the rule instead of a separate array and rules are stored without dummy codes" << endl;
+    cerr << "\t\tflat*: same as the encoding without the prefix but every rule is stored in one contiguous buffer" << endl;
+    cerr << "\t\tword*: same as flat* but values are packed so they can be read with a single unaligned 64-bit load" << endl;
+    cerr << "\t\tef*: same as flat* but rules are stored without dummy codes and their offsets and lengths are stored in an Elias-Fano encoding" << endl;
+    cerr << "\t\tdac: same as efarray but characters are stored with directly addressable codes" << endl;
+    cerr << "\t\tpair: a flat array of rule pairs; navarro, bigrepair, and text grammars only" << endl;
+    cerr << "\t\tbppair: same as pair but every character is bit packed with the same width" << endl;
+    cerr << "\t\tdyn*: same as the encoding without the prefix but accessed with virtual dispatch; for benchmarking static dispatch" << endl;
+    cerr << "\t\t*64: same as the encoding without the suffix but characters and rule lengths are 64-bit, e.g. array64; for grammars with billions of rules or characters; not available for dyn*" << endl;
     cerr << "\tquerysize: the size of the substring to query for when benchmarking" << endl;
     cerr << "\tnumqueries: the number of queries to run when benchmarking" << endl;
     cerr << "\tseed: the seed to use with the pseudo-random number generator" << endl;
 }
 
+// the flags given before the positional arguments
+struct Options {
+    bool index = false;
+    // 0 if --threads wasn't given
+    uint32_t numThreads = 0;
+    string extractFile;
+    // 0 if --cache wasn't given
+    uint64_t cacheLength = 0;
+    uint64_t cacheMemory = UINT64_MAX;
+    // 0 if --sample wasn't given
+    uint64_t sampleLength = 0;
+    // 0 if --block-cache wasn't given
+    uint64_t blockCacheMemory = 0;
+    string backend = "sd";
+};
+
 template <class JaggedArray_T>
-CFG<JaggedArray_T>* loadGrammar(string type, string filename) {
+CFG<JaggedArray_T>* loadGrammar(string type, string filename, Allocation allocation) {
     if (type == "mrrepair") {
-        return CFG<JaggedArray_T>::fromMrRepairFile(filename + ".out");
+        return CFG<JaggedArray_T>::fromMrRepairFile(filename + ".out", allocation);
     } else if (type == "navarro") {
-        return CFG<JaggedArray_T>::fromNavarroFiles(filename + ".C", filename + ".R");
+        return CFG<JaggedArray_T>::fromNavarroFiles(filename + ".C", filename + ".R", allocation);
     } else if (type == "bigrepair") {
-        return CFG<JaggedArray_T>::fromBigRepairFiles(filename + ".C", filename + ".R");
+        return CFG<JaggedArray_T>::fromBigRepairFiles(filename + ".C", filename + ".R", allocation);
+    } else if (type == "text") {
+        return CFG<JaggedArray_T>::fromTextFile(filename, allocation);
     }
     cerr << "invalid grammar type: \"" << type << "\"" << endl;
     cerr << endl;
     return NULL;
 }
 
-template <class JaggedArray_T>
-void benchmark(JaggedArray_T* cfg, uint32_t querySize, uint32_t numQueries, xoroshiro::xoroshiro128plus_engine& eng) {
+// resets the peak resident set size so that every load reports its own peak;
+// this is Linux specific and does nothing elsewhere
+void resetPeakMemory() {
+    ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+// the peak resident set size in bytes since the last reset, or 0 if it's unknown
+uint64_t peakMemory() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+// runs numQueries queries on every thread at once, each thread with its own
+// query context and its own random stream, for 1, 2, 4, ... up to numThreads
+// threads
+template <class CFG_T>
+void benchmarkThreads(CFG_T* cfg, RandomAccess<CFG_T>& ra, uint32_t querySize, uint32_t numQueries, uint32_t numThreads, xoroshiro::xoroshiro128plus_engine& eng) {
+    std::cerr << "running concurrent benchmarks..." << std::endl;
+    std::vector<xoroshiro::xoroshiro128plus_engine> engines(numThreads, eng);
+    for (uint32_t i = 1; i < numThreads; i++) {
+        engines[i] = engines[i - 1];
+        engines[i].jump();
+    }
+
+    double singleThroughput = 0;
+    for (uint32_t threads = 1; ; threads = std::min(2 * threads, numThreads)) {
+        chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+        runInParallel(threads, [&](uint64_t thread) {
+            typename RandomAccess<CFG_T>::Context context(cfg);
+            xoroshiro::xoroshiro128plus_engine threadEng = engines[thread];
+            std::uniform_real_distribution<> dist(0.0, 1.0);
+            std::vector<char> out(querySize);
+            for (uint32_t j = 0; j < numQueries; j++) {
+                uint64_t begin = (cfg->getTextLength() - querySize) * dist(threadEng);
+                ra.get(context, out.data(), begin, begin + querySize - 1);
+            }
+        });
+        chrono::steady_clock::time_point endTime = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(endTime - startTime).count();
+        double throughput = (double) threads * numQueries / seconds;
+        if (threads == 1) singleThroughput = throughput;
+        cerr << "\tthreads: " << threads << ", throughput: " << throughput << "[queries/s], speedup: " << throughput / singleThroughput << endl;
+        if (threads == numThreads) break;
+    }
+}
+
+// the number of hot regions of the skewed workload, the share of the text
+// they cover together, and the share of the queries that start in them
+static const uint32_t HOT_REGIONS = 16;
+static const double HOT_TEXT = 0.01;
+static const double HOT_QUERIES = 0.9;
+
+// the block cache's blocks are the smallest power of two at least
+// BLOCK_QUERIES queries long, so that admitting a block costs about as much
+// as a few queries, but no more than MAX_BLOCK_SIZE characters; the small
+// cache holds 1/SMALL_CACHE of the hot regions, so most of them don't fit
+static const uint64_t BLOCK_QUERIES = 4;
+static const uint64_t MAX_BLOCK_SIZE = 4096;
+static const uint64_t SMALL_CACHE = 16;
+
+// runs a skewed workload, where most queries start in a few hot regions of the
+// text, without a block cache, with one of the given size, and with one too
+// small for the hot regions; the same queries are run every loop, so the
+// cached loops after the first one show the cache when it's warm
+template <class CFG_T>
+void benchmarkSkewed(CFG_T* cfg, RandomAccess<CFG_T>& ra, string name, uint32_t querySize, uint32_t numQueries, uint64_t blockCacheMemory, xoroshiro::xoroshiro128plus_engine& eng) {
+    std::cerr << "running skewed benchmarks..." << std::endl;
+    uint64_t maxBegin = cfg->getTextLength() - querySize;
+    uint64_t regionSize = std::max((uint64_t) 1, (uint64_t) (maxBegin * HOT_TEXT / HOT_REGIONS));
+    std::uniform_real_distribution<> dist(0.0, 1.0);
+    std::vector<uint64_t> regions(HOT_REGIONS);
+    for (uint32_t i = 0; i < HOT_REGIONS; i++) {
+        regions[i] = (maxBegin - std::min(maxBegin, regionSize)) * dist(eng);
+    }
+    std::vector<uint64_t> begins(numQueries);
+    for (uint32_t j = 0; j < numQueries; j++) {
+        if (dist(eng) < HOT_QUERIES) {
+            uint64_t region = regions[(uint64_t) (HOT_REGIONS * dist(eng)) % HOT_REGIONS];
+            begins[j] = std::min(maxBegin, region + (uint64_t) (regionSize * dist(eng)));
+        } else {
+            begins[j] = maxBegin * dist(eng);
+        }
+    }
+
+    typename RandomAccess<CFG_T>::Context context(cfg);
+    typename BlockCache<CFG_T>::Context cacheContext(cfg);
+    std::vector<char> out(querySize);
+    uint32_t numLoops = 11;
+    std::vector<double> times(numLoops);
+    auto time = [&](auto get) {
+        for (uint32_t i = 0; i < numLoops; i++) {
+            chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+            for (uint32_t j = 0; j < numQueries; j++) {
+                get(out.data(), begins[j], begins[j] + querySize - 1);
+            }
+            chrono::steady_clock::time_point endTime = chrono::steady_clock::now();
+            times[i] = (double) chrono::duration_cast<chrono::microseconds>(endTime - startTime).count() / numQueries;
+        }
+        std::sort(times.begin(), times.end());
+        return times[numLoops / 2];
+    };
+    double uncachedTime = time([&](char* out, uint64_t begin, uint64_t end) { ra.get(context, out, begin, end); });
+    cerr << "average skewed " << name << " query time: " << uncachedTime << "[µs]" << endl;
+
+    uint64_t blockSize = 1;
+    while (blockSize < BLOCK_QUERIES * querySize && blockSize < MAX_BLOCK_SIZE) blockSize *= 2;
+    uint64_t smallCacheMemory = std::max(blockSize, HOT_REGIONS * (regionSize + querySize) / SMALL_CACHE);
+    auto benchmarkCache = [&](string label, uint64_t memory) {
+        BlockCache<CFG_T> cache(cfg, ra, memory, blockSize);
+        double cachedTime = time([&](char* out, uint64_t begin, uint64_t end) { cache.get(cacheContext, out, begin, end); });
+        uint64_t blocks = cache.getHits() + cache.getMisses();
+        cerr << "\t" << label << " slots: " << cache.getNumSlots() << ", block size: " << cache.getBlockSize() << endl;
+        cerr << "\t" << label << " mem size: " << cache.memSize() << endl;
+        cerr << "\t" << label << " hits: " << cache.getHits() << ", misses: " << cache.getMisses() << ", hit rate: " << (blocks > 0 ? (double) cache.getHits() / blocks : 0) << endl;
+        cerr << "average skewed " << name << " query time with " << label << ": " << cachedTime << "[µs], speedup: " << uncachedTime / cachedTime << endl;
+    };
+    benchmarkCache("block cache", blockCacheMemory);
+    benchmarkCache("small block cache", smallCacheMemory);
+}
+
+template <class CFG_T>
+void benchmark(CFG_T* cfg, RandomAccess<CFG_T>& ra, string name, uint32_t querySize, uint32_t numQueries, uint32_t numThreads, uint64_t blockCacheMemory, xoroshiro::xoroshiro128plus_engine& eng) {
     // print grammar stats
     cerr << "\ttext length: " << cfg->getTextLength() << endl;
     cerr << "\tnum rules: " << cfg->getNumRules() << endl;
@@ -59,12 +242,18 @@ void benchmark(JaggedArray_T* cfg, uint32_t querySize, uint32_t numQueries, xoro
     uint64_t cfgMemSize = cfg->memSize();
     cerr << "\tmem size: " << cfgMemSize << endl;
 
-    // instantiate indexes
-    RandomAccessSD sd(cfg);
-    uint64_t sdMemSize = sd.memSize();
-    cerr << "\tsd mem size: " << sdMemSize << endl;
+    uint64_t indexMemSize = ra.memSize();
+    cerr << "\t" << name << " mem size: " << indexMemSize << endl;
+    if (ra.getNumCachedRules() > 0) {
+        cerr << "\tcached rules: " << ra.getNumCachedRules() << endl;
+        cerr << "\tcache mem size: " << ra.cacheMemSize() << endl;
+    }
+    if (ra.getNumSampledRules() > 0) {
+        cerr << "\tsampled rules: " << ra.getNumSampledRules() << ", sample length: " << ra.getSampleLength() << endl;
+        cerr << "\tsample mem size: " << ra.sampleMemSize() << endl;
+    }
 
-    cerr << "\ttotal mem size: " << cfgMemSize + sdMemSize << endl;
+    cerr << "\ttotal mem size: " << cfgMemSize + indexMemSize << endl;
     
     // generate the original text
     //cfg->get(cout, 0, cfg->getTextLength() - 1);
@@ -75,35 +264,278 @@ void benchmark(JaggedArray_T* cfg, uint32_t querySize, uint32_t numQueries, xoro
     uint32_t numLoops = 11;
 
     std::uniform_real_distribution<> dist(0.0, 1.0);
-    uint64_t begin, end;
     char* out = new char[querySize];
     std::vector<double> times(numLoops);
 
+    // the queries of a loop are generated before it's timed and the loop is
+    // timed as a whole, since a single query can take less than the clock's
+    // resolution
+    std::vector<uint64_t> begins(numQueries), ends(numQueries);
+    auto generate = [&]() {
+      for (int j = 0; j < numQueries; j++) {
+          begins[j] = (cfg->getTextLength() - querySize) * dist(eng);
+          ends[j] = begins[j] + querySize - 1;
+      }
+    };
+
     //cout.setstate(std::ios::failbit);
     for (int i = 0; i < numLoops; i++) {
-      double durationSD = 0;
+      generate();
+      startTime = chrono::steady_clock::now();
       for (int j = 0; j < numQueries; j++) {
-          begin = (cfg->getTextLength() - querySize) * dist(eng);
-          end = begin + querySize - 1;
-          startTime = chrono::steady_clock::now();
-          //sd.get(cout, begin, end);
-          sd.get(out, begin, end);
-          endTime = chrono::steady_clock::now();
-          durationSD += chrono::duration_cast<chrono::microseconds>(endTime - startTime).count();
+          //ra.get(cout, begins[j], ends[j]);
+          ra.get(out, begins[j], ends[j]);
       }
+      endTime = chrono::steady_clock::now();
+      times[i] = chrono::duration<double, std::micro>(endTime - startTime).count() / numQueries;
+    }
+    std::sort(times.begin(), times.end());
+
+    double singleTime = times[numLoops / 2];
+    cerr << "average " << name << " query time: " << singleTime << "[µs]" << endl;
 
-      times[i] = durationSD / numQueries;
+    // the same number of queries in one batch
+    char* batchOut = new char[(uint64_t) numQueries * querySize];
+    for (int i = 0; i < numLoops; i++) {
+      generate();
+      startTime = chrono::steady_clock::now();
+      ra.getBatch(numQueries, begins.data(), ends.data(), batchOut);
+      endTime = chrono::steady_clock::now();
+      times[i] = chrono::duration<double, std::micro>(endTime - startTime).count() / numQueries;
     }
     std::sort(times.begin(), times.end());
+    double batchTime = times[numLoops / 2];
 
-    cerr << "average SD query time: " << times[numLoops / 2] << "[µs]" << endl;
+    // queries per second, or 0 if the queries were too fast to be timed
+    auto throughput = [](double time) { return (time > 0) ? 1000000 / time : 0; };
+    cerr << "average " << name << " batch query time: " << batchTime << "[µs]" << endl;
+    cerr << name << " query throughput: " << throughput(singleTime) << "[queries/s], batch: " << throughput(batchTime) << "[queries/s]" << endl;
 
     delete[] out;
+    delete[] batchOut;
+
+    if (numThreads > 1) {
+        benchmarkThreads(cfg, ra, querySize, numQueries, numThreads, eng);
+    }
+
+    if (blockCacheMemory > 0) {
+        benchmarkSkewed(cfg, ra, name, querySize, numQueries, blockCacheMemory, eng);
+    }
+}
+
+// loads a grammar written with --index and its random access index
+template <class JaggedArray_T>
+CFG<JaggedArray_T>* loadIndex(string filename, RandomAccessSD<CFG<JaggedArray_T>>*& sd) {
+    if constexpr (SerializableJaggedArrayType<JaggedArray_T>) {
+        shared_ptr<MappedFile> file = make_shared<MappedFile>(filename + ".fras");
+        CFG<JaggedArray_T>* cfg = CFG<JaggedArray_T>::fromSerializedFile(file);
+        sd = new RandomAccessSD<CFG<JaggedArray_T>>(cfg, *file);
+        return cfg;
+    }
+    cerr << "the grammar encoding cannot be serialized" << endl;
+    return NULL;
+}
+
+// builds the random access index of a backend for a grammar
+template <class JaggedArray_T>
+RandomAccess<CFG<JaggedArray_T>>* createIndex(string backend, CFG<JaggedArray_T>* cfg) {
+    if (backend == "sd") {
+        return new RandomAccessSD<CFG<JaggedArray_T>>(cfg);
+    } else if (backend == "bv") {
+        return new RandomAccessBV<CFG<JaggedArray_T>>(cfg);
+    } else if (backend == "plain") {
+        return new RandomAccessPlain<CFG<JaggedArray_T>>(cfg);
+    }
+    cerr << "invalid backend: \"" << backend << "\"" << endl;
+    cerr << endl;
+    return NULL;
+}
+
+// writes a grammar and its random access index for the index grammar type;
+// main only allows --index with the sd backend
+template <class JaggedArray_T>
+bool writeIndex(CFG<JaggedArray_T>* cfg, RandomAccess<CFG<JaggedArray_T>>* ra, string filename) {
+    RandomAccessSD<CFG<JaggedArray_T>>* sd = static_cast<RandomAccessSD<CFG<JaggedArray_T>>*>(ra);
+    if constexpr (SerializableJaggedArrayType<JaggedArray_T>) {
+        ofstream out(filename + ".fras", ios::binary);
+        cfg->serialize(out);
+        sd->serialize(out);
+        if (out) return true;
+        cerr << "failed to write " << filename << ".fras" << endl;
+        return false;
+    }
+    cerr << "the grammar encoding cannot be serialized" << endl;
+    return false;
+}
+
+// decodes the whole text with every thread and writes it to a file
+template <class JaggedArray_T>
+bool extract(CFG<JaggedArray_T>* cfg, RandomAccess<CFG<JaggedArray_T>>* ra, string extractFile, uint32_t numThreads) {
+    uint64_t threads = (numThreads > 0) ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    ofstream out(extractFile, ios::binary);
+    ra->extract(out, 0, cfg->getTextLength(), threads);
+    out.close();
+    chrono::steady_clock::time_point endTime = chrono::steady_clock::now();
+    if (!out) {
+        cerr << "failed to write " << extractFile << endl;
+        return false;
+    }
+    double seconds = chrono::duration<double>(endTime - startTime).count();
+    cerr << "\textract threads: " << threads << endl;
+    cerr << "\textract time: " << chrono::duration_cast<chrono::milliseconds>(endTime - startTime).count() << "[ms]" << endl;
+    cerr << "\textract throughput: " << cfg->getTextLength() / seconds / 1000000 << "[MB/s]" << endl;
+    return true;
+}
+
+// the engine is copied so that every allocation is benchmarked with the same queries
+template <class JaggedArray_T>
+bool runAllocation(string type, string filename, const Options& options, Allocation allocation, uint32_t querySize, uint32_t numQueries, xoroshiro::xoroshiro128plus_engine eng) {
+    // the load time and peak memory include building or loading the random access index
+    resetPeakMemory();
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    CFG<JaggedArray_T>* cfg;
+    RandomAccess<CFG<JaggedArray_T>>* ra = NULL;
+    if (type == "index") {
+        RandomAccessSD<CFG<JaggedArray_T>>* sd = NULL;
+        cfg = loadIndex<JaggedArray_T>(filename, sd);
+        ra = sd;
+    } else {
+        cfg = loadGrammar<JaggedArray_T>(type, filename, allocation);
+        if (cfg != NULL) ra = createIndex<JaggedArray_T>(options.backend, cfg);
+    }
+    if (ra != NULL && options.cacheLength > 0) {
+        ra->cacheExpansions(options.cacheLength, options.cacheMemory);
+    }
+    if (ra != NULL && options.sampleLength > 0) {
+        ra->sampleRules(options.sampleLength);
+    }
+    chrono::steady_clock::time_point endTime = chrono::steady_clock::now();
+    if (ra == NULL) {
+        delete cfg;
+        return false;
+    }
+    cerr << "\tbackend: " << options.backend << endl;
+    cerr << "\tallocation: " << allocationName(allocation) << endl;
+    cerr << "\tload time: " << chrono::duration_cast<chrono::milliseconds>(endTime - startTime).count() << "[ms]" << endl;
+    cerr << "\tpeak memory: " << peakMemory() << endl;
+    bool success = !options.index || writeIndex(cfg, ra, filename);
+    if (success && !options.extractFile.empty()) {
+        success = extract(cfg, ra, options.extractFile, options.numThreads);
+    }
+    if (success) {
+        benchmark(cfg, *ra, options.backend, querySize, numQueries, options.numThreads, options.blockCacheMemory, eng);
+    }
+    delete ra;
+    delete cfg;
+    return success;
+}
+
+template <class JaggedArray_T>
+void run(string type, string filename, const Options& options, uint32_t querySize, uint32_t numQueries, xoroshiro::xoroshiro128plus_engine& eng) {
+    // encodings that allocate each rule separately are benchmarked with and without an arena
+    if constexpr (AllocationJaggedArrayType<JaggedArray_T>) {
+        for (Allocation allocation : {Allocation::MALLOC, Allocation::ARENA, Allocation::HUGE_PAGE_ARENA}) {
+            if (!runAllocation<JaggedArray_T>(type, filename, options, allocation, querySize, numQueries, eng)) return;
+        }
+    } else {
+        runAllocation<JaggedArray_T>(type, filename, options, Allocation::MALLOC, querySize, numQueries, eng);
+    }
+}
+
+// runs the benchmark for the given encoding with Symbol_T characters and rule
+// lengths; returns false if the encoding is invalid
+template <class Symbol_T>
+bool runEncoding(string encoding, string type, string filename, const Options& options, uint32_t querySize, uint32_t numQueries, xoroshiro::xoroshiro128plus_engine& eng) {
+    if (encoding == "array") {
+      run<JaggedArrayInt<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "bpleft") {
+      run<JaggedArrayBpIndex<JaggedArrayBp, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "bpright") {
+      run<JaggedArrayBpOpt<JaggedArrayBp, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "bpmono") {
+      run<JaggedArrayBpMono<JaggedArrayBp, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "bpheader") {
+      run<JaggedArrayBpHeader<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "flatarray") {
+      run<JaggedArrayIntFlat<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "flatbpleft") {
+      run<JaggedArrayBpIndex<JaggedArrayBpFlat, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "flatbpright") {
+      run<JaggedArrayBpOpt<JaggedArrayBpFlat, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "flatbpmono") {
+      run<JaggedArrayBpMono<JaggedArrayBpFlat, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "wordbpleft") {
+      run<JaggedArrayBpIndex<JaggedArrayBpWord, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "wordbpright") {
+      run<JaggedArrayBpOpt<JaggedArrayBpWord, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "wordbpmono") {
+      run<JaggedArrayBpMono<JaggedArrayBpWord, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "efarray") {
+      run<JaggedArrayIntEF<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "efbpleft") {
+      run<JaggedArrayBpIndex<JaggedArrayBpEF, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "efbpright") {
+      run<JaggedArrayBpOpt<JaggedArrayBpEF, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "efbpmono") {
+      run<JaggedArrayBpMono<JaggedArrayBpEF, Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "dac") {
+      run<JaggedArrayDac<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "pair") {
+      run<JaggedArrayPair<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "bppair") {
+      run<JaggedArrayPairBp<Symbol_T>>(type, filename, options, querySize, numQueries, eng);
+    } else {
+      return false;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[])
 {
 
+    // check for the flags before the positional arguments
+    Options options;
+    while (argc > 1 && string(argv[1]).starts_with("--")) {
+      string flag = argv[1];
+      if (flag == "--index") {
+        options.index = true;
+      } else if (flag == "--threads" && argc > 2) {
+        options.numThreads = std::max(1, std::stoi(argv[2]));
+        argc--;
+        argv++;
+      } else if (flag == "--extract" && argc > 2) {
+        options.extractFile = argv[2];
+        argc--;
+        argv++;
+      } else if (flag == "--cache" && argc > 2) {
+        options.cacheLength = std::stoull(argv[2]);
+        argc--;
+        argv++;
+      } else if (flag == "--cache-memory" && argc > 2) {
+        options.cacheMemory = std::stoull(argv[2]);
+        argc--;
+        argv++;
+      } else if (flag == "--sample" && argc > 2) {
+        options.sampleLength = std::stoull(argv[2]);
+        argc--;
+        argv++;
+      } else if (flag == "--backend" && argc > 2) {
+        options.backend = argv[2];
+        argc--;
+        argv++;
+      } else if (flag == "--block-cache" && argc > 2) {
+        options.blockCacheMemory = std::stoull(argv[2]);
+        argc--;
+        argv++;
+      } else {
+        usage(argc, argv);
+        return 1;
+      }
+      argc--;
+      argv++;
+    }
+
     // check the command-line arguments
     if (argc < 5) {
       usage(argc, argv);
@@ -131,23 +563,26 @@ int main(int argc, char* argv[])
     string type = argv[1];
     string filename = argv[2];
     string encoding = argv[3];
-    if (encoding == "array") {
-      CFG<JaggedArrayInt>* cfg = loadGrammar<JaggedArrayInt>(type, filename);
-      benchmark(cfg, querySize, numQueries, eng);
-      delete cfg;
-    } else if (encoding == "bpleft") {
-      CFG<JaggedArrayBpIndex>* cfg = loadGrammar<JaggedArrayBpIndex>(type, filename);
-      benchmark(cfg, querySize, numQueries, eng);
-      delete cfg;
-    } else if (encoding == "bpright") {
-      CFG<JaggedArrayBpOpt>* cfg = loadGrammar<JaggedArrayBpOpt>(type, filename);
-      benchmark(cfg, querySize, numQueries, eng);
-      delete cfg;
-    } else if (encoding == "bpmono") {
-      CFG<JaggedArrayBpMono>* cfg = loadGrammar<JaggedArrayBpMono>(type, filename);
-      benchmark(cfg, querySize, numQueries, eng);
-      delete cfg;
+    if (options.backend != "sd" && (options.index || type == "index")) {
+      cerr << "only the sd backend can be written with --index and loaded with the index type" << endl;
+      return 1;
+    }
+    // encodings with the 64 suffix use 64-bit characters and rule lengths
+    bool valid = true;
+    if (encoding == "dynarray") {
+      run<JaggedArrayVirtual<JaggedArrayInt<>>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "dynbpleft") {
+      run<JaggedArrayVirtual<JaggedArrayBpIndex<>>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "dynbpright") {
+      run<JaggedArrayVirtual<JaggedArrayBpOpt<>>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding == "dynbpmono") {
+      run<JaggedArrayVirtual<JaggedArrayBpMono<>>>(type, filename, options, querySize, numQueries, eng);
+    } else if (encoding.size() > 2 && encoding.ends_with("64")) {
+      valid = runEncoding<uint64_t>(encoding.substr(0, encoding.size() - 2), type, filename, options, querySize, numQueries, eng);
     } else {
+      valid = runEncoding<uint32_t>(encoding, type, filename, options, querySize, numQueries, eng);
+    }
+    if (!valid) {
       cerr << "invalid grammar encoding: \"" << encoding << "\"" << endl;
     }
 
@@ -32,4 +32,22 @@ void xoroshiro128plus_engine::seed(const std::array<uint32_t, 4> &a) {
   state[1] = ((uint64_t)a[2] << 32) | (uint64_t)a[3];
 }
 
+void xoroshiro128plus_engine::jump() {
+  static const uint64_t JUMP[] = { 0xbeac0467eba5facb, 0xd86b048b86aa9922 };
+
+  uint64_t s0 = 0;
+  uint64_t s1 = 0;
+  for (uint64_t jump : JUMP) {
+    for (int b = 0; b < 64; b++) {
+      if (jump & (uint64_t)1 << b) {
+        s0 ^= state[0];
+        s1 ^= state[1];
+      }
+      (*this)();
+    }
+  }
+  state[0] = s0;
+  state[1] = s1;
+}
+
 }